@@ -0,0 +1,143 @@
+/* File: arena.c
+
+   Copyright (c) 2018 David Hauweele <david@hauweele.net>
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the University nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+   OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+   SUCH DAMAGE. */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* Default size of the chunks. */
+#define CHUNK_SIZE 4096
+
+/* Alignment of the objects. */
+#define ALIGN 16
+
+struct chunk {
+  struct chunk *next;
+  size_t used;
+  size_t size;
+
+  char data[] __attribute__((aligned(ALIGN)));
+};
+
+struct arena {
+  size_t chunk_size;
+  struct chunk *chunks; /* current chunk first */
+};
+
+static struct chunk * new_chunk(size_t size)
+{
+  struct chunk *chunk = malloc(sizeof(struct chunk) + size);
+
+  if(!chunk)
+    return NULL;
+  chunk->used = 0;
+  chunk->size = size;
+
+  return chunk;
+}
+
+arena_t arena_create(size_t chunk_size)
+{
+  struct arena *arena = malloc(sizeof(struct arena));
+
+  if(!arena)
+    return NULL;
+
+  arena->chunk_size = chunk_size ? chunk_size : CHUNK_SIZE;
+  arena->chunks     = NULL;
+
+  return arena;
+}
+
+static void * alloc(struct arena *arena, size_t size, size_t align)
+{
+  struct chunk *chunk = arena->chunks;
+  size_t offset = 0;
+
+  if(chunk)
+    offset = (chunk->used + align - 1) & ~(align - 1);
+
+  if(!chunk || offset > chunk->size || chunk->size - offset < size) {
+    /* Large objects get their own chunk behind the
+       current one so that its free space is kept. */
+    if(chunk && size > arena->chunk_size / 4) {
+      struct chunk *large = new_chunk(size);
+      if(!large)
+        return NULL;
+
+      large->used = size;
+      large->next = chunk->next;
+      chunk->next = large;
+
+      return large->data;
+    }
+
+    chunk = new_chunk(size > arena->chunk_size ? size : arena->chunk_size);
+    if(!chunk)
+      return NULL;
+    chunk->next   = arena->chunks;
+    arena->chunks = chunk;
+    offset = 0;
+  }
+
+  chunk->used = offset + size;
+
+  return chunk->data + offset;
+}
+
+void * arena_alloc(arena_t arena, size_t size)
+{
+  return alloc(arena, size, ALIGN);
+}
+
+char * arena_strdup(arena_t arena, const char *s)
+{
+  size_t len = strlen(s) + 1;
+  char *d    = alloc(arena, len, 1);
+
+  if(d)
+    memcpy(d, s, len);
+  return d;
+}
+
+void arena_destroy(arena_t arena)
+{
+  struct chunk *chunk = arena->chunks;
+
+  while(chunk) {
+    struct chunk *f = chunk;
+
+    chunk = chunk->next;
+    free(f);
+  }
+
+  free(arena);
+}
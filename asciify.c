@@ -28,8 +28,7 @@
 #include <assert.h>
 
 #include "iobuf_stdout.h"
-
-#define IN_IOBUF_SIZE 4096
+#include "scan.h"
 
 /* Converts a wide char to an ASCII char. */
 const char * asciify_wchar(wchar_t wchar)
@@ -120,57 +119,56 @@ const char * asciify_wchar(wchar_t wchar)
   }
 }
 
-void proceed(int fd)
+void proceed(iofile_t file, const char *name)
 {
-  int offset = 0;
-
-  while(1) {
-    int bsize;
+  const char *window;
+  size_t line = 1;
+  ssize_t n;
+
+  /* We work directly on the input buffer. Only when a multibyte sequence
+     lies across the end of the buffered data do we ask for more bytes and
+     the buffer gets compacted. */
+  while((n = iobuf_peek(file, &window, MB_CUR_MAX)) > 0) {
     int index = 0;
-    char buf[IN_IOBUF_SIZE];
-    ssize_t n = read(fd, buf + offset, IN_IOBUF_SIZE - offset);
-
-    if(n < 0)
-      err(1, "read error");
-    else if(!n)
-      break;
 
-    bsize  = n + offset;
-    offset = 0;
-    while(index < n + offset) {
+    while(index < n) {
       const char *cchar;
       wchar_t wchar;
       int     wres;
 
-      wres = mbtowc(&wchar, buf + index, bsize - index);
+      wres = mbtowc(&wchar, window + index, n - index);
 
-      /* Special case when we leave the current buffer. It's possible that we
+      /* Special case when we leave the current window. It's possible that we
          lie on a open multibyte sequence. */
       if(wres == -1) {
-        char cp_buf[sizeof(wchar_t)];
-
-        offset = bsize - index;
-        if(offset > sizeof(wchar_t))
-          errx(2, "cannot decode multibyte string %s", buf);
-
-        memcpy(cp_buf, buf + index, offset);
-        memcpy(buf, cp_buf, sizeof(cp_buf));
+        if(n - index >= MB_CUR_MAX)
+          errx(2, "%s:%zu: cannot decode multibyte string",
+               name, line + scan_count(window, index, '\n'));
 
         /* Don't forget to reset the erroneous state. */
         (void)mbtowc(NULL, NULL, 0);
         break;
       }
+      else if(wres == 0) /* null wide character */
+        wres = 1;
 
       index += wres;
 
       cchar = asciify_wchar(wchar);
-      iobuf_printf(cchar);
+      iobuf_write(iobuf_stdout, cchar, strlen(cchar));
     }
+
+    /* Still an open multibyte sequence at EOF. */
+    if(!index)
+      errx(1, "%s:%zu: cannot decode multibyte string", name, line);
+
+    /* Lines are only counted to report where decoding failed. */
+    line += scan_count(window, index, '\n');
+    iobuf_consume(file, index);
   }
 
-  /* Check for the final multibyte parsing state */
-  if(mbtowc(NULL, NULL, 0))
-    errx(1, "cannot decode multibyte string");
+  if(n < 0)
+    err(1, "read error");
 }
 
 void exit_cb(void)
@@ -189,18 +187,33 @@ int main(int argc, char *argv[])
   iobuf_stdout_init();
   atexit(exit_cb);
 
-  if(!*argv)
-    proceed(STDIN_FILENO);
+  if(!*argv) {
+    /* Standard input is generally a pipe,
+       it is read ahead while we decode. */
+    iofile_t file = iobuf_dopen_sized(STDIN_FILENO, IOBUF_AUTO, 0,
+                                      IOBUF_ASYNC);
+    if(!file)
+      err(1, "cannot allocate input buffer");
+
+    proceed(file, "stdin");
+  }
 
   for(; *argv ; argv++) {
+    iofile_t file;
     int fd = open(*argv, O_RDONLY, 0);
 
     if(fd < 0)
       errx(1, "cannot open %s", *argv);
 
-    proceed(fd);
+    /* Files are processed directly from the page cache,
+       others fallback on the buffered mode. */
+    file = iobuf_dopen_sized(fd, IOBUF_AUTO, 0, IOBUF_MMAP);
+    if(!file)
+      err(1, "cannot allocate input buffer");
+
+    proceed(file, *argv);
 
-    close(fd);
+    iobuf_close(file);
   }
 
   return 0;
@@ -46,15 +46,15 @@
 
 #include "bsd.h"
 
-#ifndef NO_HTABLE
+#ifndef NO_IDCACHE
 
-#include "htable.h"
+#include "idcache.h"
 
-/* Hashtable for UID and GID */
-static htable_t uid_ht;
-static htable_t gid_ht;
+/* Name caches for UID and GID */
+static idcache_t uid_cache;
+static idcache_t gid_cache;
 
-#endif /* NO_HTABLE */
+#endif /* NO_IDCACHE */
 
 #ifndef NO_STRLCPY
 size_t strlcpy(char *dst, const char *src, size_t size)
@@ -145,101 +145,139 @@ void strmode(mode_t mode, char *bp)
 #endif /* NO_STRMODE */
 
 
-#ifndef NO_HTABLE
-/* We use Knuth's multiplicative hash */
-static uint32_t knuth_hash(const void *key)
+#ifndef NO_IDCACHE
+static const char * user_name(unsigned long uid)
 {
-  register uint32_t hash = (unsigned long)key;
-
-  hash *= 0x9e3779b1;
+  struct passwd *u_uid = getpwuid(uid);
 
-  return hash;
+  return u_uid ? u_uid->pw_name : NULL;
 }
 
-/* UID/GID comparison */
-static bool id_cmp(const void *s1, const void *s2)
+static const char * group_name(unsigned long gid)
 {
-  return s1 == s2;
-}
+  struct group *g_gid = getgrgid(gid);
 
-/* Destroy data from the hashtable which is only a string here */
-static void str_destroy(void *data)
-{
-  free(data);
+  return g_gid ? g_gid->gr_name : NULL;
 }
 
-static void *retrieve_user(const void *key, void *optarg)
+/* Enumerating the databases costs a single pass instead of one query
+   (possibly a network round-trip with NSS) for each new id or name. This
+   is enabled with the PRELOAD_IDS environment variable. Ids missing from
+   the enumeration are still queried on demand. */
+static void preload_users(void)
 {
-  uintptr_t uid = (uintptr_t)key;
-  struct passwd *u_uid = getpwuid(uid);
+  struct passwd *pw;
 
-  /* In case something goes wrong we use the uid as name */
-  if(!u_uid) {
-    char *str = malloc(32);
-    if(!str)
+  setpwent();
+  while((pw = getpwent()))
+    if(idcache_insert(uid_cache, pw->pw_uid, pw->pw_name) < 0)
       err(1, "malloc");
-    (void)sprintf(str, "%ld", uid);
-    return str;
-  }
-
-  return strdup(u_uid->pw_name);
+  endpwent();
 }
 
-static void *retrieve_group(const void *key, void *optarg)
+static void preload_groups(void)
 {
-  uintptr_t gid = (uintptr_t)key;
-  struct group *g_gid = getgrgid(gid);
+  struct group *gr;
 
-  /* In case something goes wrong we use the gid as name */
-  if(!g_gid) {
-    char *str = malloc(32);
-    if(!str)
+  setgrent();
+  while((gr = getgrent()))
+    if(idcache_insert(gid_cache, gr->gr_gid, gr->gr_name) < 0)
       err(1, "malloc");
-    (void)sprintf(str, "%ld", gid);
-    return str;
-  }
-
-  return strdup(g_gid->gr_name);
+  endgrent();
 }
 
 void init_uid_ht(void)
 {
-  uid_ht = ht_create(1024, knuth_hash, id_cmp, str_destroy);
+  uid_cache = idcache_create(user_name);
+
+  if(!uid_cache)
+    err(1, "idcache_create");
 
-  if(!uid_ht)
-    err(1, "ht_create");
+  if(getenv("PRELOAD_IDS"))
+    preload_users();
 }
 
 void init_gid_ht(void)
 {
-  gid_ht = ht_create(1024, knuth_hash, id_cmp, str_destroy);
+  gid_cache = idcache_create(group_name);
 
-  if(!gid_ht)
-    err(1, "ht_create");
+  if(!gid_cache)
+    err(1, "idcache_create");
+
+  if(getenv("PRELOAD_IDS"))
+    preload_groups();
 }
 
 void free_uid_ht(void)
 {
-  ht_destroy(uid_ht);
+  idcache_destroy(uid_cache);
 }
 
 void free_gid_ht(void)
 {
-  ht_destroy(gid_ht);
+  idcache_destroy(gid_cache);
 }
 
 const char * user_from_uid(uid_t uid, int nouser)
 {
-  uintptr_t p_uid = uid;
-  return ht_lookup(uid_ht, (const void *)p_uid, retrieve_user, NULL);
+  const char *name = idcache_lookup(uid_cache, uid);
+
+  if(!name)
+    err(1, "malloc");
+  return name;
 }
 
 const char * group_from_gid(gid_t gid, int nogroup)
 {
-  uintptr_t p_gid = gid;
-  return ht_lookup(gid_ht, (const void *)p_gid, retrieve_group, NULL);
+  const char *name = idcache_lookup(gid_cache, gid);
+
+  if(!name)
+    err(1, "malloc");
+  return name;
+}
+
+int uid_from_user(const char *name, uid_t *uid)
+{
+  struct passwd *pw;
+  unsigned long id;
+
+  if(!idcache_id(uid_cache, name, &id)) {
+    *uid = id;
+    return 0;
+  }
+
+  pw = getpwnam(name);
+  if(!pw)
+    return -1;
+
+  if(idcache_insert(uid_cache, pw->pw_uid, pw->pw_name) < 0)
+    err(1, "malloc");
+  *uid = pw->pw_uid;
+
+  return 0;
+}
+
+int gid_from_group(const char *name, gid_t *gid)
+{
+  struct group *gr;
+  unsigned long id;
+
+  if(!idcache_id(gid_cache, name, &id)) {
+    *gid = id;
+    return 0;
+  }
+
+  gr = getgrnam(name);
+  if(!gr)
+    return -1;
+
+  if(idcache_insert(gid_cache, gr->gr_gid, gr->gr_name) < 0)
+    err(1, "malloc");
+  *gid = gr->gr_gid;
+
+  return 0;
 }
-#endif /* NO_HTABLE */
+#endif /* NO_IDCACHE */
 
 #ifndef NO_SETMODE
 # define SET_LEN 6   /* initial # of bitcmd struct to malloc */
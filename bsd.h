@@ -41,6 +41,8 @@ void free_uid_ht(void);
 void free_gid_ht(void);
 const char *user_from_uid(uid_t uid, int nouser);
 const char *group_from_gid(gid_t gid, int nogroup);
+int uid_from_user(const char *name, uid_t *uid);
+int gid_from_group(const char *name, gid_t *gid);
 mode_t getmode(const void *bbox, mode_t omode);
 void * setmode(const char *p);
 # ifdef SETMODE_DEBUG
@@ -50,9 +50,16 @@
 #include <unistd.h>
 #include <stddef.h>
 
+#if defined(__linux__) && !defined(NO_ZERO_COPY)
+#define ZERO_COPY
+#include <sys/sendfile.h>
+#include <errno.h>
+#endif
+
 #include "bsd.h"
 #include "record-invalid.h"
 #include "common-cmdline.h"
+#include "scan.h"
 
 static int bflag, eflag, nflag, sflag, tflag, vflag;
 static int rval;
@@ -60,8 +67,11 @@ static const char *filename;
 
 static void usage(void);
 static void scanfiles(char *argv[], int cooked);
-static void cook_cat(FILE *);
+static void cook_cat(int);
 static void raw_cat(int);
+#ifdef ZERO_COPY
+static void zero_cat(int, int);
+#endif
 
 #ifndef NO_UDOM_SUPPORT
 static int udom_open(const char *path, int flags);
@@ -78,6 +88,9 @@ static int udom_open(const char *path, int flags);
  * smaller than MAXPHYS */
 #define BUFSIZE_SMALL (MAXPHYS)
 
+/* Maximum size of a single zero-copy request */
+#define ZERO_COPY_MAX (1024*1024*1024)
+
 int main(int argc, char *argv[])
 {
   common_main(argc, argv, "cat", "/bin/cat.real", usage, NULL);
@@ -135,7 +148,6 @@ static void scanfiles(char *argv[], int cooked)
 {
   int i = 0;
   char *path;
-  FILE *fp;
 
   while ((path = argv[i]) != NULL || i == 0) {
     int fd;
@@ -155,13 +167,9 @@ static void scanfiles(char *argv[], int cooked)
       warn("%s", path);
       rval = 1;
     } else if (cooked) {
-      if (fd == STDIN_FILENO)
-        cook_cat(stdin);
-      else {
-        fp = fdopen(fd, "r");
-        cook_cat(fp);
-        fclose(fp);
-      }
+      cook_cat(fd);
+      if (fd != STDIN_FILENO)
+        close(fd);
     } else {
       raw_cat(fd);
       if (fd != STDIN_FILENO)
@@ -173,61 +181,115 @@ static void scanfiles(char *argv[], int cooked)
   }
 }
 
-static void cook_cat(FILE *fp)
+/*
+ * The line number is kept in decimal and incremented in place. It is
+ * printed right aligned on six columns at least, as "%6d\t" would.
+ */
+static char lineno[] = "                    0\t";
+static char *lineno_first;
+
+#define LINENO_LAST   (lineno + sizeof(lineno) - 3)
+#define LINENO_WIDTH  6
+
+static void lineno_reset(void)
 {
-  int ch, gobble, line, prev;
-
-  /* Reset EOF condition on stdin. */
-  if (fp == stdin && feof(stdin))
-    clearerr(stdin);
-
-  line = gobble = 0;
-  for (prev = '\n'; (ch = getc(fp)) != EOF; prev = ch) {
-    if (prev == '\n') {
-      if (sflag) {
-        if (ch == '\n') {
-          if (gobble)
-            continue;
-          gobble = 1;
-        } else
-          gobble = 0;
-      }
-      if (nflag && (!bflag || ch != '\n')) {
-        (void)fprintf(stdout, "%6d\t", ++line);
-        if (ferror(stdout))
-          break;
-      }
-    }
-    if (ch == '\n') {
-      if (eflag && putchar('$') == EOF)
-        break;
-    } else if (ch == '\t') {
-      if (tflag) {
-        if (putchar('^') == EOF || putchar('I') == EOF)
-          break;
-        continue;
-      }
-    } else if (vflag) {
-      if (!isascii(ch) && !isprint(ch)) {
-        if (putchar('M') == EOF || putchar('-') == EOF)
-          break;
-        ch = toascii(ch);
+  memset(lineno, ' ', LINENO_LAST - lineno);
+  *LINENO_LAST = '0';
+  lineno_first = LINENO_LAST;
+}
+
+/* Increment the line number and print it. */
+static void lineno_print(void)
+{
+  char *p = LINENO_LAST;
+
+  while (*p == '9')
+    *p-- = '0';
+  *p = *p == ' ' ? '1' : *p + 1;
+  if (p < lineno_first)
+    lineno_first = p;
+
+  p = MIN(lineno_first, LINENO_LAST + 1 - LINENO_WIDTH);
+  fwrite(p, 1, LINENO_LAST + 2 - p, stdout);
+}
+
+/*
+ * Process the input by blocks. Runs of plain bytes, up to the next
+ * newline or, with -v, up to the next non-printable byte, are written
+ * at once. Only the bytes which stop a run are handled one by one.
+ */
+static void cook_cat(int rfd)
+{
+  static char *buf = NULL;
+  const char *p, *q, *end;
+  int ch, gobble, prev;
+  ssize_t nr;
+
+  if (buf == NULL && (buf = malloc(BUFSIZE_SMALL)) == NULL)
+    err(1, "malloc() failure of IO buffer");
+
+  lineno_reset();
+  prev = '\n';
+  gobble = 0;
+  while ((nr = read(rfd, buf, BUFSIZE_SMALL)) > 0) {
+    for (p = buf, end = buf + nr; p < end; ) {
+      if (prev == '\n') {
+        if (sflag) {
+          if (*p == '\n') {
+            if (gobble) {
+              p++;
+              continue;
+            }
+            gobble = 1;
+          } else
+            gobble = 0;
+        }
+        if (nflag && (!bflag || *p != '\n'))
+          lineno_print();
       }
-      if (iscntrl(ch)) {
-        if (putchar('^') == EOF ||
-            putchar(ch == '\177' ? '?' :
-                    ch | 0100) == EOF)
+
+      q = vflag ? scan_nonprint(p, end - p) : scan_byte(p, end - p, '\n');
+      if (q == NULL)
+        q = end;
+      if (q != p) {
+        fwrite(p, 1, q - p, stdout);
+        prev = q[-1];
+        p = q;
+        if (p == end)
           break;
-        continue;
       }
+
+      /* As before, prev is the character once stripped by -v so
+       * that M-^J starts a new line. */
+      ch = (unsigned char)*p++;
+      if (ch == '\n') {
+        if (eflag)
+          putchar('$');
+        putchar(ch);
+      } else if (ch == '\t' && tflag) {
+        putchar('^');
+        putchar('I');
+      } else if (vflag && ch != '\t') {
+        if (!isascii(ch) && !isprint(ch)) {
+          putchar('M');
+          putchar('-');
+          ch = toascii(ch);
+        }
+        if (iscntrl(ch)) {
+          putchar('^');
+          putchar(ch == '\177' ? '?' : ch | 0100);
+        } else
+          putchar(ch);
+      } else
+        putchar(ch);
+      prev = ch;
     }
-    if (putchar(ch) == EOF)
+    if (ferror(stdout))
       break;
   }
-  if (ferror(fp)) {
+  if (nr < 0) {
     warn("%s", filename);
     rval = 1;
-    clearerr(fp);
   }
   if (ferror(stdout))
     err(1, "stdout");
@@ -243,6 +305,11 @@ raw_cat(int rfd)
   struct stat sbuf;
 
   wfd = fileno(stdout);
+#ifdef ZERO_COPY
+  /* Copy as much as possible in the kernel, the buffer loop below
+   * completes what is left from the current offset. */
+  zero_cat(rfd, wfd);
+#endif
   if (buf == NULL) {
     if (fstat(wfd, &sbuf))
       err(1, "%s", filename);
@@ -268,6 +335,47 @@ raw_cat(int rfd)
   }
 }
 
+#ifdef ZERO_COPY
+
+/*
+ * Copy rfd to wfd without going through user space: copy_file_range()
+ * between regular files, splice() when either end is a pipe, and
+ * sendfile() from a regular file to anything else (socket, tty, ...).
+ * Stop on the first error, including the ones that only mean that the
+ * method is not supported for these files, and let the buffer loop
+ * handle the rest. It reports read and write errors where they belong.
+ */
+static void zero_cat(int rfd, int wfd)
+{
+  static int wmode = -1;
+  struct stat sbuf;
+  ssize_t n;
+  int rmode;
+
+  if (wmode < 0) {
+    if (fstat(wfd, &sbuf))
+      err(1, "stdout");
+    wmode = sbuf.st_mode & S_IFMT;
+  }
+  if (fstat(rfd, &sbuf))
+    return;
+  rmode = sbuf.st_mode & S_IFMT;
+
+  do {
+    if (rmode == S_IFIFO || wmode == S_IFIFO)
+      n = splice(rfd, NULL, wfd, NULL, ZERO_COPY_MAX,
+                 SPLICE_F_MOVE | SPLICE_F_MORE);
+    else if (rmode == S_IFREG && wmode == S_IFREG)
+      n = copy_file_range(rfd, NULL, wfd, NULL, ZERO_COPY_MAX, 0);
+    else if (rmode == S_IFREG)
+      n = sendfile(wfd, rfd, NULL, ZERO_COPY_MAX);
+    else
+      return;
+  } while (n > 0 || (n < 0 && errno == EINTR));
+}
+
+#endif
+
 #ifndef NO_UDOM_SUPPORT
 
 static int udom_open(const char *path, int flags)
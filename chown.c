@@ -46,6 +46,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "bsd.h"
 #include "record-invalid.h"
 #include "common-cmdline.h"
 
@@ -189,6 +190,10 @@ int main(int argc, char **argv)
   if ((argc < 2 && !ref) || (argc < 1 && ref))
     usage();
 
+  /* name to id lookups */
+  init_uid_ht();
+  init_gid_ht();
+
   if (Rflag) {
     fts_options = FTS_PHYSICAL;
     if (hflag && (Hflag || Lflag))
@@ -295,21 +300,21 @@ int main(int argc, char **argv)
 
 static gid_t a_gid(const char *s)
 {
-  struct group *gr;
+  gid_t gid;
 
   if (*s == '\0')     /* Argument was "uid[:.]". */
     return -1;
   gname = s;
-  return ((gr = getgrnam(s)) != NULL) ? gr->gr_gid : id(s, "group");
+  return (gid_from_group(s, &gid) == 0) ? gid : id(s, "group");
 }
 
 static uid_t a_uid(const char *s)
 {
-  struct passwd *pw;
+  uid_t uid;
 
   if (*s == '\0')     /* Argument was "[:.]gid". */
     return -1;
-  return ((pw = getpwnam(s)) != NULL) ? pw->pw_uid : id(s, "user");
+  return (uid_from_user(s, &uid) == 0) ? uid : id(s, "user");
 }
 
 static uid_t id(const char *name, const char *type)
@@ -0,0 +1,342 @@
+/* File: chtable-bench.c
+
+   Copyright (c) 2018 David Hauweele <david@hauweele.net>
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the University nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+   OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+   SUCH DAMAGE. */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <err.h>
+
+#include "htable.h"
+#include "chtable.h"
+
+/* Stress test and throughput benchmark of the concurrent hash table
+   against a single htable protected by a mutex. */
+
+struct context {
+  unsigned int threads;
+  unsigned long ops;
+  unsigned long keys;
+  unsigned int shards;
+  unsigned int lookups; /* percentage of lookups */
+};
+
+static struct context ctx = {
+  .threads = 4,
+  .ops     = 1000000,
+  .keys    = 65536,
+  .shards  = 64,
+  .lookups = 90
+};
+
+/* number of calls to retrieve for each key */
+static unsigned int *retrieved;
+
+/* expected presence of each key, only written by the owner thread */
+static unsigned char *record;
+static unsigned long walked;
+
+static pthread_mutex_t big_lock = PTHREAD_MUTEX_INITIALIZER;
+static htable_t big_ht;
+static chtable_t cht;
+
+static uint32_t knuth_hash(const void *key)
+{
+  return (uintptr_t)key * 0x9e3779b1;
+}
+
+static bool id_cmp(const void *k1, const void *k2)
+{
+  return k1 == k2;
+}
+
+static void no_destroy(void *data)
+{
+  (void)data;
+}
+
+static void * retrieve(const void *key, void *optarg)
+{
+  (void)optarg;
+
+  if(retrieved)
+    __atomic_add_fetch(&retrieved[(uintptr_t)key], 1, __ATOMIC_RELAXED);
+  return (void *)((uintptr_t)key + 1);
+}
+
+static uint64_t xorshift(uint64_t *state)
+{
+  uint64_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+
+  return *state = x;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Concurrent lookups of the same keys. Each key must be
+   retrieved exactly once and yield the right data. */
+static void * stress(void *arg)
+{
+  uint64_t state = (uintptr_t)arg * 0x9e3779b97f4a7c15ULL + 1;
+  unsigned long i;
+
+  for(i = 0 ; i < ctx.ops ; i++) {
+    uintptr_t key = xorshift(&state) % ctx.keys;
+    void *data    = cht_lookup(cht, (void *)key, retrieve, NULL);
+
+    if(data != (void *)(key + 1))
+      errx(1, "wrong data for key %lu", (unsigned long)key);
+  }
+
+  return NULL;
+}
+
+/* Concurrent inserts, deletes and lookups. Each thread owns the keys
+   congruent to its index and records whether they should be present.
+   Other keys are only looked up and may race with their owner. */
+static void * mixed(void *arg)
+{
+  uintptr_t id   = (uintptr_t)arg - 1;
+  uint64_t state = (uintptr_t)arg * 0x9e3779b97f4a7c15ULL + 1;
+  unsigned long i;
+
+  for(i = 0 ; i < ctx.ops ; i++) {
+    uint64_t r      = xorshift(&state);
+    uintptr_t key   = (r >> 8) % ctx.keys;
+    unsigned int op = r % 100;
+    void *data;
+
+    if(key % ctx.threads != id) {
+      data = cht_search(cht, (void *)key, NULL);
+      if(data && data != (void *)(key + 1))
+        errx(1, "wrong data for foreign key %lu", (unsigned long)key);
+      continue;
+    }
+
+    if(op < 30) {
+      cht_search(cht, (void *)key, (void *)(key + 1));
+      record[key] = 1;
+    }
+    else if(op < 60) {
+      cht_delete(cht, (void *)key);
+      record[key] = 0;
+    }
+    else if(op < 80) {
+      data = cht_lookup(cht, (void *)key, retrieve, NULL);
+      if(data != (void *)(key + 1))
+        errx(1, "wrong data for key %lu", (unsigned long)key);
+      record[key] = 1;
+    }
+    else {
+      data = cht_search(cht, (void *)key, NULL);
+      if(data != (record[key] ? (void *)(key + 1) : NULL))
+        errx(1, "key %lu %s", (unsigned long)key,
+             record[key] ? "lost" : "not deleted");
+    }
+  }
+
+  return NULL;
+}
+
+static void count(void *data)
+{
+  (void)data;
+  walked++;
+}
+
+static void * bench(void *arg)
+{
+  uint64_t state = (uintptr_t)arg * 0x9e3779b97f4a7c15ULL + 1;
+  bool sharded   = cht != NULL;
+  unsigned long i;
+
+  for(i = 0 ; i < ctx.ops ; i++) {
+    uint64_t r       = xorshift(&state);
+    uintptr_t key    = (r >> 8) % ctx.keys;
+    unsigned int op  = r % 100;
+
+    if(sharded) {
+      if(op < ctx.lookups)
+        cht_lookup(cht, (void *)key, retrieve, NULL);
+      else if(op & 1)
+        cht_search(cht, (void *)key, (void *)(key + 1));
+      else
+        cht_delete(cht, (void *)key);
+    }
+    else {
+      pthread_mutex_lock(&big_lock);
+      if(op < ctx.lookups)
+        ht_lookup(big_ht, (void *)key, retrieve, NULL);
+      else if(op & 1)
+        ht_search(big_ht, (void *)key, (void *)(key + 1));
+      else
+        ht_delete(big_ht, (void *)key);
+      pthread_mutex_unlock(&big_lock);
+    }
+  }
+
+  return NULL;
+}
+
+static double run(void *(*func)(void *))
+{
+  pthread_t *threads = malloc(ctx.threads * sizeof(pthread_t));
+  double start;
+  unsigned int i;
+
+  if(!threads)
+    err(1, "malloc");
+
+  start = now();
+  for(i = 0 ; i < ctx.threads ; i++)
+    if(pthread_create(&threads[i], NULL, func, (void *)(uintptr_t)(i + 1)))
+      errx(1, "cannot create thread");
+  for(i = 0 ; i < ctx.threads ; i++)
+    pthread_join(threads[i], NULL);
+
+  free(threads);
+  return now() - start;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-t threads] [-n ops] [-k keys] [-s shards]"
+                  " [-l lookup%%]\n", name);
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long total;
+  unsigned long i;
+  double elapsed;
+  int c;
+
+  while((c = getopt(argc, argv, "t:n:k:s:l:h")) != -1) {
+    switch(c) {
+    case 't':
+      ctx.threads = atoi(optarg);
+      break;
+    case 'n':
+      ctx.ops = strtoul(optarg, NULL, 0);
+      break;
+    case 'k':
+      ctx.keys = strtoul(optarg, NULL, 0);
+      break;
+    case 's':
+      ctx.shards = atoi(optarg);
+      break;
+    case 'l':
+      ctx.lookups = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if(!ctx.threads || !ctx.keys || ctx.lookups > 100)
+    usage(argv[0]);
+  total = ctx.threads * ctx.ops;
+
+  /* stress */
+  retrieved = calloc(ctx.keys, sizeof(unsigned int));
+  cht = cht_create(ctx.shards, 16, knuth_hash, id_cmp, no_destroy);
+  if(!retrieved || !cht)
+    err(1, "cannot create table");
+
+  run(stress);
+  for(i = 0 ; i < ctx.keys ; i++)
+    if(retrieved[i] > 1)
+      errx(1, "key %lu retrieved %u times", i, retrieved[i]);
+  printf("stress: ok\n");
+
+  cht_destroy(cht);
+  free(retrieved);
+  retrieved = NULL;
+
+  /* mixed updates */
+  record = calloc(ctx.keys, 1);
+  cht = cht_create(ctx.shards, 16, knuth_hash, id_cmp, no_destroy);
+  if(!record || !cht)
+    err(1, "cannot create table");
+
+  run(mixed);
+  for(total = 0, i = 0 ; i < ctx.keys ; i++) {
+    void *data = cht_search(cht, (void *)i, NULL);
+
+    if(data != (record[i] ? (void *)(i + 1) : NULL))
+      errx(1, "key %lu %s", i, record[i] ? "lost" : "not deleted");
+    total += record[i];
+  }
+  cht_walk(cht, count);
+  if(walked != total)
+    errx(1, "%lu entries walked, %lu expected", walked, total);
+  printf("mixed: ok\n");
+
+  cht_destroy(cht);
+  free(record);
+  total = ctx.threads * ctx.ops;
+
+  /* sharded table */
+  cht = cht_create(ctx.shards, 16, knuth_hash, id_cmp, no_destroy);
+  if(!cht)
+    err(1, "cannot create table");
+  elapsed = run(bench);
+  printf("chtable (%u shards): %.2f Mops/s\n", ctx.shards,
+         total / elapsed / 1e6);
+  cht_destroy(cht);
+  cht = NULL;
+
+  /* single table behind a mutex */
+  big_ht = ht_create(16, knuth_hash, id_cmp, no_destroy);
+  if(!big_ht)
+    err(1, "cannot create table");
+  elapsed = run(bench);
+  printf("htable + mutex:      %.2f Mops/s\n", total / elapsed / 1e6);
+  ht_destroy(big_ht);
+
+  return 0;
+}
@@ -0,0 +1,174 @@
+/* File: chtable.c
+
+   Copyright (c) 2018 David Hauweele <david@hauweele.net>
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the University nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+   OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+   SUCH DAMAGE. */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "htable.h"
+#include "chtable.h"
+
+/* Keep the locks of different shards on different cache lines. */
+#define CACHE_LINE 64
+
+struct shard {
+  pthread_mutex_t lock;
+  htable_t ht;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct chtable {
+  uint32_t (*hash)(const void *);
+  unsigned int shift;
+  unsigned int nshards;
+
+  struct shard *shards;
+};
+
+/* The shard is selected with the high bits of the hash
+   while each htable uses the low bits for its slots. The
+   hash is computed once and passed down to the shard. */
+static struct shard * shard_of(const struct chtable *cht, uint32_t hash)
+{
+  if(!cht->shift)
+    return cht->shards;
+  return &cht->shards[hash >> cht->shift];
+}
+
+chtable_t cht_create(unsigned int nshards, unsigned int nbuckets,
+                     uint32_t (*hash)(const void *),
+                     bool (*compare)(const void *, const void *),
+                     void (*destroy)(void *))
+{
+  struct chtable *cht = malloc(sizeof(struct chtable));
+  unsigned int bits = 0;
+  unsigned int i;
+
+  if(!cht)
+    return NULL;
+
+  while((1U << bits) < nshards && bits < 16)
+    bits++;
+
+  cht->hash    = hash;
+  cht->nshards = 1U << bits;
+  cht->shift   = bits ? 32 - bits : 0;
+
+  if(posix_memalign((void **)&cht->shards, CACHE_LINE,
+                    cht->nshards * sizeof(struct shard))) {
+    free(cht);
+    return NULL;
+  }
+
+  for(i = 0 ; i < cht->nshards ; i++) {
+    cht->shards[i].ht = ht_create(nbuckets, hash, compare, destroy);
+    if(!cht->shards[i].ht) {
+      while(i--) {
+        ht_destroy(cht->shards[i].ht);
+        pthread_mutex_destroy(&cht->shards[i].lock);
+      }
+      free(cht->shards);
+      free(cht);
+      return NULL;
+    }
+    pthread_mutex_init(&cht->shards[i].lock, NULL);
+  }
+
+  return cht;
+}
+
+void * cht_search(chtable_t cht, const void *key, void *data)
+{
+  uint32_t hash       = cht->hash(key);
+  struct shard *shard = shard_of(cht, hash);
+  void *ret;
+
+  pthread_mutex_lock(&shard->lock);
+  ret = ht_search_hash(shard->ht, hash, key, data);
+  pthread_mutex_unlock(&shard->lock);
+
+  return ret;
+}
+
+void * cht_lookup(chtable_t cht, const void *key,
+                  void *(retrieve)(const void *, void *),
+                  void *optarg)
+{
+  uint32_t hash       = cht->hash(key);
+  struct shard *shard = shard_of(cht, hash);
+  void *ret;
+
+  /* Holding the lock during the retrieval ensures that the
+     entry is only retrieved once. Other keys of the shard
+     wait meanwhile. */
+  pthread_mutex_lock(&shard->lock);
+  ret = ht_lookup_hash(shard->ht, hash, key, retrieve, optarg);
+  pthread_mutex_unlock(&shard->lock);
+
+  return ret;
+}
+
+void cht_delete(chtable_t cht, const void *key)
+{
+  uint32_t hash       = cht->hash(key);
+  struct shard *shard = shard_of(cht, hash);
+
+  pthread_mutex_lock(&shard->lock);
+  ht_delete_hash(shard->ht, hash, key);
+  pthread_mutex_unlock(&shard->lock);
+}
+
+void cht_walk(chtable_t cht, void (*action)(void *))
+{
+  unsigned int i;
+
+  for(i = 0 ; i < cht->nshards ; i++) {
+    struct shard *shard = &cht->shards[i];
+
+    pthread_mutex_lock(&shard->lock);
+    ht_walk(shard->ht, action);
+    pthread_mutex_unlock(&shard->lock);
+  }
+}
+
+void cht_destroy(chtable_t cht)
+{
+  unsigned int i;
+
+  for(i = 0 ; i < cht->nshards ; i++) {
+    ht_destroy(cht->shards[i].ht);
+    pthread_mutex_destroy(&cht->shards[i].lock);
+  }
+
+  free(cht->shards);
+  free(cht);
+}
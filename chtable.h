@@ -0,0 +1,69 @@
+/* File: chtable.h
+
+   Copyright (c) 2018 David Hauweele <david@hauweele.net>
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the University nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+   OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+   SUCH DAMAGE. */
+
+
+#ifndef _CHTABLE_H_
+#define _CHTABLE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct chtable * chtable_t;
+
+/* Concurrent hash table. The entries are split among nshards htable
+   each protected by its own lock so that threads working on different
+   keys seldom contend. The number of shards is rounded up to a power of
+   two, nbuckets is the initial size of each shard. The hash, compare and
+   destroy functions are the same as with ht_create(). */
+chtable_t cht_create(unsigned int nshards, unsigned int nbuckets,
+                     uint32_t (*hash)(const void *),
+                     bool (*compare)(const void *, const void *),
+                     void (*destroy)(void *));
+
+/* Same as ht_search(). */
+void * cht_search(chtable_t cht, const void *key, void *data);
+
+/* Same as ht_lookup(). The retrieve function is called at most once per
+   key even when several threads request the same missing key at once.
+   It is called with the shard locked and must not use the table. */
+void * cht_lookup(chtable_t cht, const void *key,
+                  void *(retrieve)(const void *, void *),
+                  void *optarg);
+
+/* Same as ht_delete(). */
+void cht_delete(chtable_t cht, const void *key);
+
+/* Same as ht_walk(). Each shard is locked while it is walked. */
+void cht_walk(chtable_t cht, void (*action)(void *));
+
+/* Destroy each entry and the table itself. No other
+   thread may use the table at that time. */
+void cht_destroy(chtable_t cht);
+
+#endif /* _CHTABLE_H_ */
@@ -0,0 +1,355 @@
+/* File: crc32-bench.c
+
+   Copyright (c) 2018 David Hauweele <david@hauweele.net>
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the University nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+   OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+   SUCH DAMAGE. */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <err.h>
+
+#include "crc32.h"
+
+/* Conformance and throughput of every crc32 kernel. Each kernel is
+   checked against known vectors, then against the reference table
+   kernel on random lengths, alignments and initial values. The
+   throughput is reported in GB/s for buffers of increasing size. */
+
+/* Known CRC of a text or, when text is NULL, of len bytes filled with
+   fill or increasing from zero when fill is negative. These are the
+   CRC with pre and post inversion. */
+struct vector {
+  const char *text;
+  int fill;
+  unsigned long len;
+  uint32_t crc;
+};
+
+#define TEXT(s, crc) { s, 0, sizeof(s) - 1, crc }
+#define FILL(c, len, crc) { NULL, c, len, crc }
+
+static const struct vector IEEE_vectors[] = {
+  TEXT("", 0),
+  TEXT("a", 0xe8b7be43),
+  TEXT("123456789", 0xcbf43926),
+  TEXT("The quick brown fox jumps over the lazy dog", 0x414fa339),
+  FILL(0x00, 32, 0x190a55ad),
+  FILL(0xff, 32, 0xff6cab0b),
+  FILL(-1,   32, 0x91267e8a),
+  { NULL, 0, 0, 0 }
+};
+
+/* The last three are from RFC 3720 (iSCSI). */
+static const struct vector c_vectors[] = {
+  TEXT("", 0),
+  TEXT("a", 0xc1d04330),
+  TEXT("123456789", 0xe3069283),
+  TEXT("The quick brown fox jumps over the lazy dog", 0x22620404),
+  FILL(0x00, 32, 0x8a9136aa),
+  FILL(0xff, 32, 0x62a8ab43),
+  FILL(-1,   32, 0x46dd794e),
+  { NULL, 0, 0, 0 }
+};
+
+static const struct vector K_vectors[] = {
+  TEXT("", 0),
+  TEXT("a", 0x0da2aa8a),
+  TEXT("123456789", 0x2d3dd0ae),
+  TEXT("The quick brown fox jumps over the lazy dog", 0xe021db90),
+  FILL(0x00, 32, 0x7f842e8f),
+  FILL(0xff, 32, 0x0bfca160),
+  FILL(-1,   32, 0x09e30ba3),
+  { NULL, 0, 0, 0 }
+};
+
+struct polynomial {
+  const char *name;
+  const struct crc32_kernel * (*kernels)(void);
+  uint32_t (*update)(const unsigned char *, unsigned long, uint32_t);
+  uint32_t (*combine)(uint32_t, uint32_t, uint64_t);
+  int inverted; /* the public function inverts the CRC */
+  const struct vector *vectors;
+};
+
+static const struct polynomial polynomials[] = {
+  { "ieee", crc32_IEEE_kernel_list, crc32_IEEE, crc32_IEEE_combine, 1,
+    IEEE_vectors },
+  { "c",    crc32_c_kernel_list,    crc32_c,    crc32_c_combine,    0,
+    c_vectors },
+  { "k",    crc32_K_kernel_list,    crc32_K,    crc32_K_combine,    1,
+    K_vectors },
+  { NULL, NULL, NULL, NULL, 0, NULL }
+};
+
+/* Throughput is measured on these buffer sizes. */
+static const unsigned long sizes[] = { 64, 4096, 1 << 20, 1 << 30, 0 };
+
+/* Each size is processed repeatedly up to this amount of data. */
+#define BENCH_BYTES (256 * 1024 * 1024)
+
+/* Random buffers are this large plus room for misalignment. */
+#define RANDOM_SIZE (128 * 1024)
+#define MAX_ALIGN   64
+
+static unsigned int failures;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t xorshift(uint64_t *state)
+{
+  uint64_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+
+  return *state = x;
+}
+
+static void fill_random(unsigned char *buf, unsigned long len, uint64_t *state)
+{
+  while(len--)
+    *buf++ = xorshift(state);
+}
+
+static int supported(const struct crc32_kernel *k)
+{
+  return !k->supported || k->supported();
+}
+
+static void fail(const struct polynomial *poly, const char *kernel,
+                 const char *test, unsigned long len, uint32_t expected,
+                 uint32_t crc)
+{
+  warnx("%s/%s: %s on %lu bytes gives 0x%08x instead of 0x%08x",
+        poly->name, kernel, test, len, crc, expected);
+  failures++;
+}
+
+static void check_vectors(const struct polynomial *poly)
+{
+  const struct crc32_kernel *k;
+  const struct vector *v;
+
+  for(v = poly->vectors ; v->text || v->len ; v++) {
+    unsigned char buf[64];
+    const unsigned char *s = (const unsigned char *)v->text;
+    uint32_t crc;
+
+    if(!s) {
+      unsigned long i;
+
+      for(i = 0 ; i < v->len ; i++)
+        buf[i] = v->fill < 0 ? (unsigned char)i : (unsigned char)v->fill;
+      s = buf;
+    }
+
+    for(k = poly->kernels() ; k->name ; k++) {
+      if(!supported(k))
+        continue;
+
+      crc = ~k->crc(s, v->len, 0xffffffff);
+      if(crc != v->crc)
+        fail(poly, k->name, "vector", v->len, v->crc, crc);
+    }
+
+    crc = poly->inverted ? poly->update(s, v->len, 0)
+                         : ~poly->update(s, v->len, 0xffffffff);
+    if(crc != v->crc)
+      fail(poly, "public", "vector", v->len, v->crc, crc);
+  }
+}
+
+/* Compare each kernel with the reference on random inputs and check that
+   the combination of two parts gives the CRC of the whole. The lengths
+   are spread over every power of two up to the random buffer size. */
+static void check_random(const struct polynomial *poly,
+                         const unsigned char *random,
+                         unsigned long count, uint64_t *state)
+{
+  const struct crc32_kernel *kernels = poly->kernels();
+  const struct crc32_kernel *ref, *k;
+  unsigned long i;
+
+  for(ref = kernels ; ref[1].name ; ref++);
+
+  for(i = 0 ; i < count ; i++) {
+    unsigned int bits          = xorshift(state) % 18;
+    unsigned long len          = xorshift(state) % (1UL << bits);
+    const unsigned char *s     = random + xorshift(state) % MAX_ALIGN;
+    uint32_t init              = xorshift(state);
+    unsigned long split        = len ? xorshift(state) % len : 0;
+    uint32_t expected          = ref->crc(s, len, init);
+    uint32_t crc;
+
+    for(k = kernels ; k != ref ; k++) {
+      if(!supported(k))
+        continue;
+
+      crc = k->crc(s, len, init);
+      if(crc != expected)
+        fail(poly, k->name, "random", len, expected, crc);
+    }
+
+    expected = poly->update(s, len, init);
+    crc      = poly->combine(poly->update(s, split, init),
+                             poly->update(s + split, len - split, 0),
+                             len - split);
+    if(crc != expected)
+      fail(poly, "public", "combine", len, expected, crc);
+  }
+}
+
+static void bench(const struct polynomial *poly, const unsigned char *buf,
+                  unsigned long max_size)
+{
+  const struct crc32_kernel *k;
+
+  for(k = poly->kernels() ; k->name ; k++) {
+    const unsigned long *size;
+
+    if(!supported(k))
+      continue;
+
+    printf("%-5s %-7s", poly->name, k->name);
+
+    for(size = sizes ; *size ; size++) {
+      unsigned long n = BENCH_BYTES / *size, i;
+      volatile uint32_t crc = 0;
+      double start;
+
+      if(*size > max_size)
+        break;
+
+      if(!n)
+        n = 1;
+
+      start = now();
+      for(i = 0 ; i < n ; i++)
+        crc = k->crc(buf, *size, crc);
+      printf(" %9.2f", (double)n * *size / (now() - start) * 1e-9);
+    }
+
+    printf("\n");
+  }
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-c] [-a ieee|c|k] [-n count] [-s max-size]\n"
+                  "With -c only the conformance is checked. Random tests"
+                  " default to 100000\nand sizes up to 1 GiB.\n", name);
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  const struct polynomial *poly, *only = NULL;
+  unsigned long count = 100000, max_size = 1 << 30;
+  const unsigned long *size;
+  unsigned char *random, *buf;
+  uint64_t state = 88172645463325252ULL;
+  int cflag = 0;
+  int c;
+
+  while((c = getopt(argc, argv, "a:cn:s:h")) != -1) {
+    switch(c) {
+    case 'a':
+      for(only = polynomials ; only->name ; only++)
+        if(!strcmp(only->name, optarg))
+          break;
+      if(!only->name)
+        usage(argv[0]);
+      break;
+    case 'c':
+      cflag = 1;
+      break;
+    case 'n':
+      count = strtoul(optarg, NULL, 0);
+      break;
+    case 's':
+      max_size = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  random = malloc(RANDOM_SIZE + MAX_ALIGN);
+  if(!random)
+    err(1, "malloc");
+  fill_random(random, RANDOM_SIZE + MAX_ALIGN, &state);
+
+  printf("selected: ieee=%s c=%s k=%s\n",
+         crc32_IEEE_kernel(), crc32_c_kernel(), crc32_K_kernel());
+
+  for(poly = polynomials ; poly->name ; poly++) {
+    if(only && poly != only)
+      continue;
+
+    check_vectors(poly);
+    check_random(poly, random, count, &state);
+  }
+
+  free(random);
+
+  if(failures)
+    errx(1, "%u failures", failures);
+  printf("conformance: ok\n");
+
+  if(cflag)
+    return 0;
+
+  /* the largest size which fits in the limit */
+  for(size = sizes ; size[1] && size[1] <= max_size ; size++);
+  buf = malloc(*size);
+  if(!buf)
+    err(1, "malloc");
+  fill_random(buf, *size, &state);
+
+  printf("%-5s %-7s %9s %9s %9s %9s  (GB/s)\n",
+         "poly", "kernel", "64B", "4KiB", "1MiB", "1GiB");
+  for(poly = polynomials ; poly->name ; poly++)
+    if(!only || poly == only)
+      bench(poly, buf, max_size);
+
+  free(buf);
+
+  return 0;
+}
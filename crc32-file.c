@@ -27,8 +27,14 @@
    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
    SUCH DAMAGE. */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -36,31 +42,302 @@
 #include <err.h>
 
 #include "crc32.h"
+#include "iobuf.h"
+#include "iobuf_stdout.h"
 
-#define IOBUF_SIZE 65535
+/* Size of the read buffer of each thread. */
+#define READ_SIZE (1024 * 1024)
 
-int main(int argc, char **argv)
+/* Regular files are split in chunks of this size by default,
+   checksummed concurrently and combined afterward. */
+#define CHUNK_SIZE (32 * 1024 * 1024)
+
+struct algorithm {
+  const char *name;
+  uint32_t (*update)(const unsigned char *, unsigned long, uint32_t);
+  uint32_t (*combine)(uint32_t, uint32_t, uint64_t);
+};
+
+static const struct algorithm algorithms[] = {
+  { "ieee", crc32_IEEE, crc32_IEEE_combine },
+  { "c",    crc32_c,    crc32_c_combine },
+  { "k",    crc32_K,    crc32_K_combine },
+  { NULL, NULL, NULL }
+};
+
+static const struct algorithm *algorithm = &algorithms[1];
+static int mflag;
+
+struct file {
+  const char *path;   /* NULL for stdin */
+  int fd;              /* -1 until the first chunk is scheduled */
+  off_t size;          /* -1 when the file cannot be split */
+  unsigned long nchunks;
+  unsigned long done;  /* number of chunks checksummed */
+  uint32_t *crcs;      /* CRC of each chunk */
+};
+
+static struct file *files;
+static unsigned int nfiles;
+static off_t chunk_size = CHUNK_SIZE;
+
+/* next chunk to checksum */
+static unsigned int next_file;
+static unsigned long next_chunk;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  done = PTHREAD_COND_INITIALIZER;
+
+static void usage(void)
 {
-  /* TODO: accept CRC32 variants from cmdline */
-  argv++;
-  for(; *argv ; argv++) {
-    unsigned long crc = 0;
-    ssize_t n;
-    int fd;
-    unsigned char buf[IOBUF_SIZE];
+  (void)fprintf(stderr, "usage: crc32 [-m] [-a ieee|c|k] [-j threads] "
+                "[-c chunk-size] [files ...]\n");
+  exit(1);
+}
+
+/* Checksum up to len bytes from offset, or until the end of the file
+   when len is negative. */
+static uint32_t checksum(int fd, const char *path, unsigned char *buf,
+                         off_t offset, off_t len)
+{
+  uint32_t crc = 0;
+
+  /* Checksum the chunk directly from the mapping of an iobuf stream in
+     mmap mode instead of copying it. The stream gets its own descriptor
+     since it is closed with the stream. */
+  if(mflag && len > 0) {
+    int copy = dup(fd);
+    iofile_t in = copy < 0 ? NULL : iobuf_dopen_sized(copy, 0, 0, IOBUF_MMAP);
+
+    if(in) {
+      if(iobuf_lseek(in, offset, SEEK_SET) < 0)
+        err(1, "seek \"%s\"", path);
 
-    fd = open(*argv, O_RDONLY);
-    if(fd < 0)
-      err(1, "open");
+      while(len) {
+        const char *window;
+        ssize_t n = iobuf_peek(in, &window, 1);
 
-    while((n = read(fd, buf, IOBUF_SIZE)) > 0)
-      crc = crc32_c(buf, n, crc);
+        if(n < 0)
+          err(1, "read \"%s\"", path);
+        else if(!n)
+          break;
+
+        if(n > len)
+          n = len;
+        crc  = algorithm->update((const unsigned char *)window, n, crc);
+        len -= n;
+        iobuf_consume(in, n);
+      }
+
+      iobuf_close(in);
+      return crc;
+    }
+    else if(copy >= 0)
+      close(copy);
+  }
+
+  while(len) {
+    size_t size = len < 0 || len > READ_SIZE ? READ_SIZE : (size_t)len;
+    ssize_t n   = len < 0 ? read(fd, buf, size)
+                          : pread(fd, buf, size, offset);
 
     if(n < 0)
-      err(1, "read");
+      err(1, "read \"%s\"", path);
+    else if(!n)
+      break;
+
+    crc     = algorithm->update(buf, n, crc);
+    offset += n;
+    if(len > 0)
+      len -= n;
+  }
+
+  return crc;
+}
+
+static void * worker(void *arg)
+{
+  unsigned char *buf = malloc(READ_SIZE);
+
+  (void)arg;
+  if(!buf)
+    err(1, "malloc");
+
+  while(1) {
+    struct file *file;
+    unsigned long chunk;
+    off_t offset, len;
+
+    pthread_mutex_lock(&lock);
+    if(next_file == nfiles) {
+      pthread_mutex_unlock(&lock);
+      break;
+    }
+    file  = &files[next_file];
+    chunk = next_chunk++;
+    if(next_chunk == file->nchunks) {
+      next_file++;
+      next_chunk = 0;
+    }
+
+    /* The worker which takes the first chunk opens the file, the
+       others wait for its descriptor. Files are only open while their
+       chunks are being checksummed, so at most one file per worker
+       is open at any time. */
+    if(chunk) {
+      while(file->fd < 0)
+        pthread_cond_wait(&done, &lock);
+    }
+    pthread_mutex_unlock(&lock);
 
-    close(fd);
+    if(!chunk) {
+      int fd = STDIN_FILENO;
 
-    printf("%lu %s\n", crc, *argv);
+      if(file->path && (fd = open(file->path, O_RDONLY)) < 0)
+        err(1, "open \"%s\"", file->path);
+
+      pthread_mutex_lock(&lock);
+      file->fd = fd;
+      pthread_cond_broadcast(&done);
+      pthread_mutex_unlock(&lock);
+    }
+
+    offset = chunk * chunk_size;
+    len    = file->size < 0 ? -1 : file->size - offset;
+    if(len > chunk_size)
+      len = chunk_size;
+
+    file->crcs[chunk] = checksum(file->fd, file->path ? file->path : "stdin",
+                                 buf, offset, len);
+
+    /* The last chunk closes the file. Chunks are read with pread() so
+       they do not depend on the offset of the shared descriptor. */
+    pthread_mutex_lock(&lock);
+    if(++file->done == file->nchunks && file->path)
+      close(file->fd);
+    pthread_cond_broadcast(&done);
+    pthread_mutex_unlock(&lock);
   }
+
+  free(buf);
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_t *threads;
+  unsigned int i;
+  int stdin_seen = 0;
+  long t;
+  int c;
+
+  while((c = getopt(argc, argv, "a:j:c:mh")) != -1) {
+    switch(c) {
+    case 'a':
+      for(algorithm = algorithms ; algorithm->name ; algorithm++)
+        if(!strcmp(algorithm->name, optarg))
+          break;
+      if(!algorithm->name)
+        errx(1, "unknown algorithm \"%s\"", optarg);
+      break;
+    case 'j':
+      nthreads = atol(optarg);
+      break;
+    case 'c':
+      chunk_size = strtoll(optarg, NULL, 0);
+      break;
+    case 'm':
+      mflag = 1;
+      break;
+    default:
+      usage();
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  if(nthreads < 1 || chunk_size < 1)
+    usage();
+
+  /* Stream standard input when no file is given. */
+  nfiles = argc ? argc : 1;
+  files  = calloc(nfiles, sizeof(struct file));
+  if(!files)
+    err(1, "malloc");
+
+  for(i = 0 ; i < nfiles ; i++) {
+    struct file *file = &files[i];
+    struct stat st;
+
+    if(argc && strcmp(argv[i], "-"))
+      file->path = argv[i];
+    file->fd = -1;
+
+    /* Standard input is always read sequentially. It cannot be read
+       twice and concurrently by different workers. */
+    if(!file->path) {
+      if(stdin_seen++)
+        errx(1, "standard input given more than once");
+      file->size    = -1;
+      file->nchunks = 1;
+    }
+    else if(stat(file->path, &st) < 0)
+      err(1, "stat \"%s\"", file->path);
+    /* Only regular files can be read at any offset. */
+    else if(S_ISREG(st.st_mode) && st.st_size > 0) {
+      file->size    = st.st_size;
+      file->nchunks = (st.st_size + chunk_size - 1) / chunk_size;
+    }
+    else {
+      file->size    = S_ISREG(st.st_mode) ? 0 : -1;
+      file->nchunks = 1;
+    }
+
+    file->crcs = malloc(file->nchunks * sizeof(uint32_t));
+    if(!file->crcs)
+      err(1, "malloc");
+  }
+
+  iobuf_stdout_init();
+
+  threads = malloc(nthreads * sizeof(pthread_t));
+  if(!threads)
+    err(1, "malloc");
+  for(t = 0 ; t < nthreads ; t++)
+    if(pthread_create(&threads[t], NULL, worker, NULL))
+      errx(1, "cannot create thread");
+
+  /* Print the files in order as soon as they are complete. */
+  for(i = 0 ; i < nfiles ; i++) {
+    struct file *file = &files[i];
+    uint32_t crc;
+    unsigned long j;
+
+    pthread_mutex_lock(&lock);
+    while(file->done < file->nchunks)
+      pthread_cond_wait(&done, &lock);
+    pthread_mutex_unlock(&lock);
+
+    crc = file->crcs[0];
+    for(j = 1 ; j < file->nchunks ; j++) {
+      off_t len = file->size - j * chunk_size;
+      crc = algorithm->combine(crc, file->crcs[j],
+                               len > chunk_size ? chunk_size : len);
+    }
+
+    iobuf_put_udec(iobuf_stdout, crc, 0, ' ');
+    iobuf_putc(' ', iobuf_stdout);
+    iobuf_put_str(iobuf_stdout, file->path ? file->path : "-", 0);
+    iobuf_putc('\n', iobuf_stdout);
+  }
+
+  for(t = 0 ; t < nthreads ; t++)
+    pthread_join(threads[t], NULL);
+  free(threads);
+
+  iobuf_stdout_destroy();
+
+  return 0;
 }
@@ -23,156 +23,427 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "crc32.h"
 
-/* TODO:
-    - ARM64 HW
-    - CRC-32K
-*/
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define CRC32_X86
+# include <immintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+# define CRC32_LITTLE_ENDIAN
+#endif
+
+/* The ARMv8 crc32 instructions are optional in ARMv8.0. */
+#if defined(__GNUC__) && defined(__aarch64__) && defined(CRC32_LITTLE_ENDIAN)
+# define CRC32_ARM64
+# if defined(__linux__) && !defined(__ARM_FEATURE_CRC32)
+#  include <sys/auxv.h>
+#  ifndef HWCAP_CRC32
+#   define HWCAP_CRC32 (1 << 7)
+#  endif
+# endif
+#endif
+
+/* Every kernel is built in and the best one supported by the CPU is
+   selected at startup. The CRC32_KERNEL environment variable may name
+   another kernel, for example to compare them. */
+static const struct crc32_kernel *
+select_kernel(const struct crc32_kernel *kernels)
+{
+  const char *name = getenv("CRC32_KERNEL");
+  const struct crc32_kernel *k;
+
+  if(name)
+    for(k = kernels ; k->name ; k++)
+      if(!strcmp(k->name, name) && (!k->supported || k->supported()))
+        return k;
+
+  for(k = kernels ; k->name ; k++)
+    if(!k->supported || k->supported())
+      return k;
+
+  /* the last kernel is always supported */
+  return k - 1;
+}
+
+/* Slicing-by-8 tables. The first table is the classic byte at a time
+   table, the others advance the CRC of one more zero byte each so that
+   eight bytes are processed with eight independent lookups. */
+typedef uint32_t slice8_tbl[8][256];
+
+static void slice8_init(slice8_tbl tbl, uint32_t reversed)
+{
+  unsigned int i, j;
+
+  for(i = 0 ; i < 256 ; i++) {
+    uint32_t crc = i;
+
+    for(j = 0 ; j < 8 ; j++)
+      crc = (crc >> 1) ^ (reversed & -(crc & 1));
+    tbl[0][i] = crc;
+  }
+
+  for(i = 0 ; i < 256 ; i++)
+    for(j = 1 ; j < 8 ; j++)
+      tbl[j][i] = (tbl[j - 1][i] >> 8) ^ tbl[0][tbl[j - 1][i] & 0xff];
+}
+
+static uint32_t slice8(const slice8_tbl tbl, const unsigned char *s,
+                       unsigned long len, uint32_t crc)
+{
+#ifdef CRC32_LITTLE_ENDIAN
+  while(len >= 8) {
+    uint32_t lo, hi;
+
+    memcpy(&lo, s, 4);
+    memcpy(&hi, s + 4, 4);
+    lo ^= crc;
+
+    crc = tbl[7][lo & 0xff] ^ tbl[6][(lo >> 8) & 0xff] ^
+          tbl[5][(lo >> 16) & 0xff] ^ tbl[4][lo >> 24] ^
+          tbl[3][hi & 0xff] ^ tbl[2][(hi >> 8) & 0xff] ^
+          tbl[1][(hi >> 16) & 0xff] ^ tbl[0][hi >> 24];
+
+    s   += 8;
+    len -= 8;
+  }
+#endif
+
+  while(len--)
+    crc = tbl[0][(crc ^ *s++) & 0xff] ^ (crc >> 8);
+
+  return crc;
+}
+
+/* Multiply a vector by a matrix over GF(2). */
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec)
+{
+  uint32_t sum = 0;
+
+  for(; vec ; vec >>= 1, mat++)
+    if(vec & 1)
+      sum ^= *mat;
+
+  return sum;
+}
+
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat)
+{
+  unsigned int n;
+
+  for(n = 0 ; n < 32 ; n++)
+    square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+/* Build the tables of the operator that appends len zero bytes
+   to a message, given its CRC, for the reversed polynomial. */
+static void crc32_zeros(uint32_t zeros[4][256], uint32_t reversed,
+                        unsigned long len)
+{
+  uint32_t even[32], odd[32];
+  uint32_t *op = even;
+  uint32_t row = 1;
+  unsigned int n;
+
+  /* operator for one zero bit */
+  odd[0] = reversed;
+  for(n = 1 ; n < 32 ; n++, row <<= 1)
+    odd[n] = row;
+
+  /* square it for 2, 4 then 8 zero bits, one byte */
+  gf2_matrix_square(even, odd);
+  gf2_matrix_square(odd, even);
+  gf2_matrix_square(even, odd);
+
+  /* and as many times as needed for len bytes, len is a power of two */
+  for(; len > 1 ; len >>= 1) {
+    gf2_matrix_square(op == even ? odd : even, op);
+    op = op == even ? odd : even;
+  }
+
+  for(n = 0 ; n < 256 ; n++) {
+    zeros[0][n] = gf2_matrix_times(op, n);
+    zeros[1][n] = gf2_matrix_times(op, n << 8);
+    zeros[2][n] = gf2_matrix_times(op, n << 16);
+    zeros[3][n] = gf2_matrix_times(op, n << 24);
+  }
+}
+
+/* Append len zero bytes to a message given its CRC by applying the
+   one zero bit operator squared for each bit of len, as zlib does. */
+static uint32_t crc32_zeros_len(uint32_t reversed, uint32_t crc,
+                                uint64_t len)
+{
+  uint32_t even[32], odd[32];
+  uint32_t row = 1;
+  unsigned int n;
+
+  if(!len)
+    return crc;
+
+  odd[0] = reversed;
+  for(n = 1 ; n < 32 ; n++, row <<= 1)
+    odd[n] = row;
+
+  gf2_matrix_square(even, odd);
+  gf2_matrix_square(odd, even);
+
+  /* even holds the operator for one zero byte on the first pass */
+  do {
+    gf2_matrix_square(even, odd);
+    if(len & 1)
+      crc = gf2_matrix_times(even, crc);
+    len >>= 1;
+    if(!len)
+      break;
+
+    gf2_matrix_square(odd, even);
+    if(len & 1)
+      crc = gf2_matrix_times(odd, crc);
+    len >>= 1;
+  } while(len);
+
+  return crc;
+}
+
+static inline uint32_t crc32_shift(uint32_t zeros[4][256], uint32_t crc)
+{
+  return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+         zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+#ifdef CRC32_X86
+static int cpu_has_pclmul(void)
+{
+  return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse2");
+}
+
+static int cpu_has_sse42(void)
+{
+  return __builtin_cpu_supports("sse4.2");
+}
+#endif
+
+#ifdef CRC32_ARM64
+static int cpu_has_crc32(void)
+{
+# if defined(__ARM_FEATURE_CRC32)
+  return 1;
+# elif defined(__linux__)
+  return !!(getauxval(AT_HWCAP) & HWCAP_CRC32);
+# else
+  return 0;
+# endif
+}
+
+/* The instructions are enabled in the assembler whatever the target
+   architecture given to the compiler since they are only used when
+   the CPU supports them. Both polynomials share the same loop. */
+# define CRC32_ARM64_KERNEL(name, insn)                                 \
+  static uint32_t name(const unsigned char *s,                          \
+                       unsigned long len,                               \
+                       uint32_t crc)                                    \
+  {                                                                     \
+    uint64_t w;                                                         \
+                                                                        \
+    while(len && ((uintptr_t)s & 7)) {                                  \
+      __asm__(".arch_extension crc\n\t"                                 \
+              insn "b %w[crc], %w[crc], %w[c]"                          \
+              : [crc] "+r" (crc) : [c] "r" ((uint32_t)*s++));           \
+      len--;                                                            \
+    }                                                                   \
+                                                                        \
+    for(; len >= 8 ; len -= 8, s += 8) {                                \
+      memcpy(&w, s, 8);                                                 \
+      __asm__(".arch_extension crc\n\t"                                 \
+              insn "x %w[crc], %w[crc], %x[w]"                          \
+              : [crc] "+r" (crc) : [w] "r" (w));                        \
+    }                                                                   \
+                                                                        \
+    while(len--)                                                        \
+      __asm__(".arch_extension crc\n\t"                                 \
+              insn "b %w[crc], %w[crc], %w[c]"                          \
+              : [crc] "+r" (crc) : [c] "r" ((uint32_t)*s++));           \
+                                                                        \
+    return crc;                                                         \
+  }
+#endif /* CRC32_ARM64 */
 
-#ifdef USE_CRC32_IEEE
 /* The classic CRC32 used in Ethernet, GZ, BZ2, PNG, PNG, MPEG2, ...
    This is generally called simply 'crc32'. In this implementation
    it is called 'crc32_IEEE' to avoid confusion with other common
-   polynomial. Unfortunately there is no hardware optimization.
+   polynomial. There is no dedicated instruction but it can be
+   computed with carry-less multiplications (PCLMULQDQ) on x86.
 
    Name      : crc32_IEEE
    Polynomial: 0x04c11db7
    Reversed  : 0xedb88320
 */
-static const uint32_t crc32_IEEE_tbl[] = {
-  0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL,
-  0x076dc419L, 0x706af48fL, 0xe963a535L, 0x9e6495a3L,
-  0x0edb8832L, 0x79dcb8a4L, 0xe0d5e91eL, 0x97d2d988L,
-  0x09b64c2bL, 0x7eb17cbdL, 0xe7b82d07L, 0x90bf1d91L,
-  0x1db71064L, 0x6ab020f2L, 0xf3b97148L, 0x84be41deL,
-  0x1adad47dL, 0x6ddde4ebL, 0xf4d4b551L, 0x83d385c7L,
-  0x136c9856L, 0x646ba8c0L, 0xfd62f97aL, 0x8a65c9ecL,
-  0x14015c4fL, 0x63066cd9L, 0xfa0f3d63L, 0x8d080df5L,
-  0x3b6e20c8L, 0x4c69105eL, 0xd56041e4L, 0xa2677172L,
-  0x3c03e4d1L, 0x4b04d447L, 0xd20d85fdL, 0xa50ab56bL,
-  0x35b5a8faL, 0x42b2986cL, 0xdbbbc9d6L, 0xacbcf940L,
-  0x32d86ce3L, 0x45df5c75L, 0xdcd60dcfL, 0xabd13d59L,
-  0x26d930acL, 0x51de003aL, 0xc8d75180L, 0xbfd06116L,
-  0x21b4f4b5L, 0x56b3c423L, 0xcfba9599L, 0xb8bda50fL,
-  0x2802b89eL, 0x5f058808L, 0xc60cd9b2L, 0xb10be924L,
-  0x2f6f7c87L, 0x58684c11L, 0xc1611dabL, 0xb6662d3dL,
-  0x76dc4190L, 0x01db7106L, 0x98d220bcL, 0xefd5102aL,
-  0x71b18589L, 0x06b6b51fL, 0x9fbfe4a5L, 0xe8b8d433L,
-  0x7807c9a2L, 0x0f00f934L, 0x9609a88eL, 0xe10e9818L,
-  0x7f6a0dbbL, 0x086d3d2dL, 0x91646c97L, 0xe6635c01L,
-  0x6b6b51f4L, 0x1c6c6162L, 0x856530d8L, 0xf262004eL,
-  0x6c0695edL, 0x1b01a57bL, 0x8208f4c1L, 0xf50fc457L,
-  0x65b0d9c6L, 0x12b7e950L, 0x8bbeb8eaL, 0xfcb9887cL,
-  0x62dd1ddfL, 0x15da2d49L, 0x8cd37cf3L, 0xfbd44c65L,
-  0x4db26158L, 0x3ab551ceL, 0xa3bc0074L, 0xd4bb30e2L,
-  0x4adfa541L, 0x3dd895d7L, 0xa4d1c46dL, 0xd3d6f4fbL,
-  0x4369e96aL, 0x346ed9fcL, 0xad678846L, 0xda60b8d0L,
-  0x44042d73L, 0x33031de5L, 0xaa0a4c5fL, 0xdd0d7cc9L,
-  0x5005713cL, 0x270241aaL, 0xbe0b1010L, 0xc90c2086L,
-  0x5768b525L, 0x206f85b3L, 0xb966d409L, 0xce61e49fL,
-  0x5edef90eL, 0x29d9c998L, 0xb0d09822L, 0xc7d7a8b4L,
-  0x59b33d17L, 0x2eb40d81L, 0xb7bd5c3bL, 0xc0ba6cadL,
-  0xedb88320L, 0x9abfb3b6L, 0x03b6e20cL, 0x74b1d29aL,
-  0xead54739L, 0x9dd277afL, 0x04db2615L, 0x73dc1683L,
-  0xe3630b12L, 0x94643b84L, 0x0d6d6a3eL, 0x7a6a5aa8L,
-  0xe40ecf0bL, 0x9309ff9dL, 0x0a00ae27L, 0x7d079eb1L,
-  0xf00f9344L, 0x8708a3d2L, 0x1e01f268L, 0x6906c2feL,
-  0xf762575dL, 0x806567cbL, 0x196c3671L, 0x6e6b06e7L,
-  0xfed41b76L, 0x89d32be0L, 0x10da7a5aL, 0x67dd4accL,
-  0xf9b9df6fL, 0x8ebeeff9L, 0x17b7be43L, 0x60b08ed5L,
-  0xd6d6a3e8L, 0xa1d1937eL, 0x38d8c2c4L, 0x4fdff252L,
-  0xd1bb67f1L, 0xa6bc5767L, 0x3fb506ddL, 0x48b2364bL,
-  0xd80d2bdaL, 0xaf0a1b4cL, 0x36034af6L, 0x41047a60L,
-  0xdf60efc3L, 0xa867df55L, 0x316e8eefL, 0x4669be79L,
-  0xcb61b38cL, 0xbc66831aL, 0x256fd2a0L, 0x5268e236L,
-  0xcc0c7795L, 0xbb0b4703L, 0x220216b9L, 0x5505262fL,
-  0xc5ba3bbeL, 0xb2bd0b28L, 0x2bb45a92L, 0x5cb36a04L,
-  0xc2d7ffa7L, 0xb5d0cf31L, 0x2cd99e8bL, 0x5bdeae1dL,
-  0x9b64c2b0L, 0xec63f226L, 0x756aa39cL, 0x026d930aL,
-  0x9c0906a9L, 0xeb0e363fL, 0x72076785L, 0x05005713L,
-  0x95bf4a82L, 0xe2b87a14L, 0x7bb12baeL, 0x0cb61b38L,
-  0x92d28e9bL, 0xe5d5be0dL, 0x7cdcefb7L, 0x0bdbdf21L,
-  0x86d3d2d4L, 0xf1d4e242L, 0x68ddb3f8L, 0x1fda836eL,
-  0x81be16cdL, 0xf6b9265bL, 0x6fb077e1L, 0x18b74777L,
-  0x88085ae6L, 0xff0f6a70L, 0x66063bcaL, 0x11010b5cL,
-  0x8f659effL, 0xf862ae69L, 0x616bffd3L, 0x166ccf45L,
-  0xa00ae278L, 0xd70dd2eeL, 0x4e048354L, 0x3903b3c2L,
-  0xa7672661L, 0xd06016f7L, 0x4969474dL, 0x3e6e77dbL,
-  0xaed16a4aL, 0xd9d65adcL, 0x40df0b66L, 0x37d83bf0L,
-  0xa9bcae53L, 0xdebb9ec5L, 0x47b2cf7fL, 0x30b5ffe9L,
-  0xbdbdf21cL, 0xcabac28aL, 0x53b39330L, 0x24b4a3a6L,
-  0xbad03605L, 0xcdd70693L, 0x54de5729L, 0x23d967bfL,
-  0xb3667a2eL, 0xc4614ab8L, 0x5d681b02L, 0x2a6f2b94L,
-  0xb40bbe37L, 0xc30c8ea1L, 0x5a05df1bL, 0x2d02ef8dL
-};
+static slice8_tbl crc32_IEEE_tbl;
 
-uint32_t crc32_IEEE(const unsigned char *s,
-                    unsigned long len,
-                    uint32_t crc)
+static uint32_t crc32_IEEE_table(const unsigned char *s,
+                                 unsigned long len,
+                                 uint32_t crc)
 {
-  crc = ~crc;
-
   while(len--)
-    crc = crc32_IEEE_tbl[(crc ^ *s++) & 0xff] ^ (crc >> 8);
+    crc = crc32_IEEE_tbl[0][(crc ^ *s++) & 0xff] ^ (crc >> 8);
 
-  return ~crc;
+  return crc;
 }
-#endif /* USE_CRC32_IEEE */
 
+static uint32_t crc32_IEEE_slice8(const unsigned char *s,
+                                  unsigned long len,
+                                  uint32_t crc)
+{
+  return slice8((const uint32_t (*)[256])crc32_IEEE_tbl, s, len, crc);
+}
 
+#ifdef CRC32_X86
+/* Fold the message by 64 bytes then 16 bytes and reduce it with Barrett's
+   method as described in "Fast CRC Computation for Generic Polynomials
+   Using PCLMULQDQ Instruction" (Intel, 2009). The constants are the
+   bit-reflected x^(4*128+32), x^(4*128-32), x^(128+32), x^(128-32) and
+   x^64 mod P, followed by P and floor(x^64 / P). The length must be a
+   multiple of 16 and at least 64. */
+__attribute__((target("pclmul,sse2")))
+static uint32_t crc32_IEEE_fold(const unsigned char *s,
+                                unsigned long len,
+                                uint32_t crc)
+{
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  const __m128i k5   = _mm_set_epi64x(0, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
 
-#ifdef USE_CRC32_C
-/* The Castagnoli polynomial also known as 'crc32c'.
-   Another common CRC32 polynomial used in SCTP, ext4,
-   BTRFS, ... It is generally used in newer standards,
-   and has the benefits of hardware optimizations on
-   some architectures.
+  x1 = _mm_loadu_si128((const __m128i *)(s + 0x00));
+  x2 = _mm_loadu_si128((const __m128i *)(s + 0x10));
+  x3 = _mm_loadu_si128((const __m128i *)(s + 0x20));
+  x4 = _mm_loadu_si128((const __m128i *)(s + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  s   += 64;
+  len -= 64;
 
-   Name      : crc32_c
-   Polynomial: 0x1edc6f41
-   Reversed  : 0x82f63b78
-*/
-# ifdef __SSE4_2__ /* crc32 instruction was introduced with SSE 4.2 */
+  /* fold by 64 bytes */
+  x0 = k1k2;
+  while(len >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
 
-#  ifdef __x86_64__
-typedef uint64_t wide_reg;
-#   define CRC32_OPERAND_SIZE "q"
-#  else  /* __i386__ */
-typedef uint32_t wide_reg;
-#   define CRC32_OPERAND_SIZE "l"
-#  endif /* arch */
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
 
-static unsigned long crc32_intel(const unsigned char *s,
-                                 unsigned long len,
-                                 unsigned long crc)
-{
-  unsigned int quot = len / sizeof(wide_reg);
-  unsigned int rem  = len % sizeof(wide_reg);
-  const wide_reg * ul = (const wide_reg *)s;
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                       _mm_loadu_si128((const __m128i *)(s + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                       _mm_loadu_si128((const __m128i *)(s + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                       _mm_loadu_si128((const __m128i *)(s + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                       _mm_loadu_si128((const __m128i *)(s + 0x30)));
 
-  while(quot--)
-    __asm__("crc32" CRC32_OPERAND_SIZE " %[ul], %[crc]"
-            : [crc] "=r" (crc)
-            : "[crc]" (crc), [ul] "r" (*ul++));
+    s   += 64;
+    len -= 64;
+  }
 
-  s = (const unsigned char *)ul;
-  while(rem--)
-    __asm__("crc32b %[s], %[crc]"
-            : [crc] "=r" (crc)
-            : "[crc]" (crc), [s] "r" (*s++));
+  /* fold the four lanes into one */
+  x0 = k3k4;
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
 
-  return crc;
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* fold by 16 bytes */
+  while(len >= 16) {
+    x2 = _mm_loadu_si128((const __m128i *)s);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    s   += 16;
+    len -= 16;
+  }
+
+  /* 128 bits to 64 bits */
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask);
+  x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits */
+  x2 = _mm_and_si128(x1, mask);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
 }
 
-uint32_t crc32_c(const unsigned char *s,
-                 unsigned long len,
-                 uint32_t crc)
+static uint32_t crc32_IEEE_pclmul(const unsigned char *s,
+                                  unsigned long len,
+                                  uint32_t crc)
 {
-  return crc32_intel(s, len, crc);
+  if(len >= 64) {
+    unsigned long n = len & ~15UL;
+
+    crc  = crc32_IEEE_fold(s, n, crc);
+    s   += n;
+    len -= n;
+  }
+
+  return crc32_IEEE_slice8(s, len, crc);
 }
-# else /* generic */
+#endif /* CRC32_X86 */
+
+#ifdef CRC32_ARM64
+CRC32_ARM64_KERNEL(crc32_IEEE_arm64, "crc32")
+#endif
+
+static const struct crc32_kernel crc32_IEEE_kernels[] = {
+#ifdef CRC32_X86
+  { "pclmul", crc32_IEEE_pclmul, cpu_has_pclmul },
+#endif
+#ifdef CRC32_ARM64
+  { "arm64",  crc32_IEEE_arm64,  cpu_has_crc32 },
+#endif
+  { "slice8", crc32_IEEE_slice8, NULL },
+  { "table",  crc32_IEEE_table,  NULL },
+  { NULL, NULL, NULL }
+};
+
+static const struct crc32_kernel *crc32_IEEE_impl = &crc32_IEEE_kernels[0];
+
+/* The Castagnoli polynomial also known as 'crc32c'.
+   Another common CRC32 polynomial used in SCTP, ext4,
+   BTRFS, ... It is generally used in newer standards,
+   and has the benefits of hardware optimizations on
+   some architectures.
+
+   Name      : crc32_c
+   Polynomial: 0x1edc6f41
+   Reversed  : 0x82f63b78
+*/
 static const uint32_t crc32_c_tbl[] = {
   0x00000000L, 0xf26b8303L, 0xe13b70f7L, 0x1350f3f4L,
   0xc79a971fL, 0x35f1141cL, 0x26a1e7e8L, 0xd4ca64ebL,
@@ -240,14 +511,253 @@ static const uint32_t crc32_c_tbl[] = {
   0xbe2da0a5L, 0x4c4623a6L, 0x5f16d052L, 0xad7d5351L
 };
 
-uint32_t crc32_c(const unsigned char *s,
-                 unsigned long len,
-                 uint32_t crc)
+static slice8_tbl crc32_c_slice_tbl;
+
+static uint32_t crc32_c_table(const unsigned char *s,
+                              unsigned long len,
+                              uint32_t crc)
 {
   while(len--)
     crc = crc32_c_tbl[(crc ^ *s++) & 0xff] ^ (crc >> 8);
 
   return crc;
 }
-# endif
-#endif /* USE_CRC32_C */
+
+static uint32_t crc32_c_slice8(const unsigned char *s,
+                               unsigned long len,
+                               uint32_t crc)
+{
+  return slice8((const uint32_t (*)[256])crc32_c_slice_tbl, s, len, crc);
+}
+
+#ifdef CRC32_X86 /* crc32 instruction was introduced with SSE 4.2 */
+# ifdef __x86_64__
+typedef uint64_t wide_reg;
+#  define CRC32_OPERAND_SIZE "q"
+# else  /* __i386__ */
+typedef uint32_t wide_reg;
+#  define CRC32_OPERAND_SIZE "l"
+# endif /* arch */
+
+/* Three streams of the crc32 instruction are interleaved to hide its
+   latency (3 cycles for a throughput of one per cycle). Each stream
+   covers a contiguous block, the CRC of the first block is then shifted
+   over the length of the next one with the zeros operator tables below
+   and combined with the CRC of this block. This is the method of Mark
+   Adler's crc32c.c. */
+# define CRC32_C_LONG  8192
+# define CRC32_C_SHORT 256
+
+static uint32_t crc32_c_long[4][256];
+static uint32_t crc32_c_short[4][256];
+
+static inline unsigned long crc32_c_word(unsigned long crc, wide_reg w)
+{
+  __asm__("crc32" CRC32_OPERAND_SIZE " %[w], %[crc]"
+          : [crc] "=r" (crc)
+          : "[crc]" (crc), [w] "r" (w));
+  return crc;
+}
+
+static inline unsigned long crc32_c_byte(unsigned long crc, unsigned char c)
+{
+  __asm__("crc32b %[c], %[crc]"
+          : [crc] "=r" (crc)
+          : "[crc]" (crc), [c] "r" (c));
+  return crc;
+}
+
+static uint32_t crc32_c_sse42(const unsigned char *s,
+                              unsigned long len,
+                              uint32_t crc32)
+{
+  const unsigned char *end;
+  unsigned long crc = crc32;
+
+  /* align the words */
+  while(len && ((uintptr_t)s & (sizeof(wide_reg) - 1))) {
+    crc = crc32_c_byte(crc, *s++);
+    len--;
+  }
+
+  while(len >= 3 * CRC32_C_LONG) {
+    unsigned long crc1 = 0, crc2 = 0;
+
+    for(end = s + CRC32_C_LONG ; s < end ; s += sizeof(wide_reg)) {
+      crc  = crc32_c_word(crc,  *(const wide_reg *)s);
+      crc1 = crc32_c_word(crc1, *(const wide_reg *)(s + CRC32_C_LONG));
+      crc2 = crc32_c_word(crc2, *(const wide_reg *)(s + 2 * CRC32_C_LONG));
+    }
+    crc = crc32_shift(crc32_c_long, crc) ^ crc1;
+    crc = crc32_shift(crc32_c_long, crc) ^ crc2;
+
+    s   += 2 * CRC32_C_LONG;
+    len -= 3 * CRC32_C_LONG;
+  }
+
+  while(len >= 3 * CRC32_C_SHORT) {
+    unsigned long crc1 = 0, crc2 = 0;
+
+    for(end = s + CRC32_C_SHORT ; s < end ; s += sizeof(wide_reg)) {
+      crc  = crc32_c_word(crc,  *(const wide_reg *)s);
+      crc1 = crc32_c_word(crc1, *(const wide_reg *)(s + CRC32_C_SHORT));
+      crc2 = crc32_c_word(crc2, *(const wide_reg *)(s + 2 * CRC32_C_SHORT));
+    }
+    crc = crc32_shift(crc32_c_short, crc) ^ crc1;
+    crc = crc32_shift(crc32_c_short, crc) ^ crc2;
+
+    s   += 2 * CRC32_C_SHORT;
+    len -= 3 * CRC32_C_SHORT;
+  }
+
+  for(; len >= sizeof(wide_reg) ; len -= sizeof(wide_reg), s += sizeof(wide_reg))
+    crc = crc32_c_word(crc, *(const wide_reg *)s);
+
+  while(len--)
+    crc = crc32_c_byte(crc, *s++);
+
+  return crc;
+}
+#endif /* CRC32_X86 */
+
+#ifdef CRC32_ARM64
+CRC32_ARM64_KERNEL(crc32_c_arm64, "crc32c")
+#endif
+
+static const struct crc32_kernel crc32_c_kernels[] = {
+#ifdef CRC32_X86
+  { "sse42",  crc32_c_sse42,  cpu_has_sse42 },
+#endif
+#ifdef CRC32_ARM64
+  { "arm64",  crc32_c_arm64,  cpu_has_crc32 },
+#endif
+  { "slice8", crc32_c_slice8, NULL },
+  { "table",  crc32_c_table,  NULL },
+  { NULL, NULL, NULL }
+};
+
+static const struct crc32_kernel *crc32_c_impl = &crc32_c_kernels[0];
+
+/* The Koopman polynomial has a better Hamming distance than the two
+   others for messages up to 16 KiB. No CPU implements it so it only
+   has table kernels. It uses the same pre and post inversion as
+   crc32_IEEE.
+
+   Name      : crc32_K
+   Polynomial: 0x741b8cd7
+   Reversed  : 0xeb31d82e
+*/
+static slice8_tbl crc32_K_tbl;
+
+static uint32_t crc32_K_table(const unsigned char *s,
+                              unsigned long len,
+                              uint32_t crc)
+{
+  while(len--)
+    crc = crc32_K_tbl[0][(crc ^ *s++) & 0xff] ^ (crc >> 8);
+
+  return crc;
+}
+
+static uint32_t crc32_K_slice8(const unsigned char *s,
+                               unsigned long len,
+                               uint32_t crc)
+{
+  return slice8((const uint32_t (*)[256])crc32_K_tbl, s, len, crc);
+}
+
+static const struct crc32_kernel crc32_K_kernels[] = {
+  { "slice8", crc32_K_slice8, NULL },
+  { "table",  crc32_K_table,  NULL },
+  { NULL, NULL, NULL }
+};
+
+static const struct crc32_kernel *crc32_K_impl = &crc32_K_kernels[0];
+
+/* The tables are built and the kernels selected before main(),
+   so that concurrent callers never race on them. */
+__attribute__((constructor))
+static void crc32_init(void)
+{
+  slice8_init(crc32_IEEE_tbl, 0xedb88320);
+  slice8_init(crc32_c_slice_tbl, 0x82f63b78);
+  slice8_init(crc32_K_tbl, 0xeb31d82e);
+
+#ifdef CRC32_X86
+  crc32_zeros(crc32_c_long, 0x82f63b78, CRC32_C_LONG);
+  crc32_zeros(crc32_c_short, 0x82f63b78, CRC32_C_SHORT);
+  __builtin_cpu_init();
+#endif
+
+  crc32_IEEE_impl = select_kernel(crc32_IEEE_kernels);
+  crc32_c_impl    = select_kernel(crc32_c_kernels);
+  crc32_K_impl    = select_kernel(crc32_K_kernels);
+}
+
+uint32_t crc32_IEEE(const unsigned char *s,
+                    unsigned long len,
+                    uint32_t crc)
+{
+  return ~crc32_IEEE_impl->crc(s, len, ~crc);
+}
+
+uint32_t crc32_c(const unsigned char *s,
+                 unsigned long len,
+                 uint32_t crc)
+{
+  return crc32_c_impl->crc(s, len, crc);
+}
+
+uint32_t crc32_K(const unsigned char *s,
+                 unsigned long len,
+                 uint32_t crc)
+{
+  return ~crc32_K_impl->crc(s, len, ~crc);
+}
+
+/* The same formula applies with or without inversion since
+   the inversions of both sides cancel out. */
+uint32_t crc32_IEEE_combine(uint32_t crc1, uint32_t crc2, uint64_t len2)
+{
+  return crc32_zeros_len(0xedb88320, crc1, len2) ^ crc2;
+}
+
+uint32_t crc32_c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2)
+{
+  return crc32_zeros_len(0x82f63b78, crc1, len2) ^ crc2;
+}
+
+uint32_t crc32_K_combine(uint32_t crc1, uint32_t crc2, uint64_t len2)
+{
+  return crc32_zeros_len(0xeb31d82e, crc1, len2) ^ crc2;
+}
+
+const char * crc32_IEEE_kernel(void)
+{
+  return crc32_IEEE_impl->name;
+}
+
+const char * crc32_c_kernel(void)
+{
+  return crc32_c_impl->name;
+}
+
+const char * crc32_K_kernel(void)
+{
+  return crc32_K_impl->name;
+}
+
+const struct crc32_kernel * crc32_IEEE_kernel_list(void)
+{
+  return crc32_IEEE_kernels;
+}
+
+const struct crc32_kernel * crc32_c_kernel_list(void)
+{
+  return crc32_c_kernels;
+}
+
+const struct crc32_kernel * crc32_K_kernel_list(void)
+{
+  return crc32_K_kernels;
+}
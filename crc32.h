@@ -27,16 +27,51 @@
 
 #include <stdint.h>
 
-#ifdef USE_CRC32_IEEE
+/* The classic CRC32 (gzip, PNG, Ethernet). The CRC is inverted before
+   and after the update, start with zero. */
 uint32_t crc32_IEEE(const unsigned char *s,
                     unsigned long len,
                     uint32_t crc);
-#endif /* USE_CRC32_IEEE */
 
-#ifdef USE_CRC32_C
+/* The Castagnoli CRC32 (SCTP, ext4, iSCSI). This is the raw update
+   without inversion. */
 uint32_t crc32_c(const unsigned char *s,
                  unsigned long len,
                  uint32_t crc);
-#endif /* USE_CRC32_C */
+
+/* The Koopman CRC32 (CRC-32K). The CRC is inverted before and after
+   the update like crc32_IEEE, start with zero. */
+uint32_t crc32_K(const unsigned char *s,
+                 unsigned long len,
+                 uint32_t crc);
+
+/* Return the CRC of the concatenation of two messages given their CRCs
+   and the length of the second one. The CRC of the second message must
+   be computed from zero. */
+uint32_t crc32_IEEE_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+uint32_t crc32_c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+uint32_t crc32_K_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+
+/* Name of the kernel selected for each polynomial. The CRC32_KERNEL
+   environment variable overrides the selection when it names a kernel
+   supported by the CPU. */
+const char * crc32_IEEE_kernel(void);
+const char * crc32_c_kernel(void);
+const char * crc32_K_kernel(void);
+
+/* A kernel works on the raw CRC register, without pre or post inversion.
+   It may only be called when supported is NULL or returns non-zero. */
+struct crc32_kernel {
+  const char *name;
+  uint32_t (*crc)(const unsigned char *s, unsigned long len, uint32_t crc);
+  int (*supported)(void);
+};
+
+/* Every kernel built in for each polynomial, from the fastest to the
+   slowest. The list ends with a NULL name, the last kernel is the
+   reference byte at a time table. */
+const struct crc32_kernel * crc32_IEEE_kernel_list(void);
+const struct crc32_kernel * crc32_c_kernel_list(void);
+const struct crc32_kernel * crc32_K_kernel_list(void);
 
 #endif /* _CRC32_H_ */
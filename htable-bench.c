@@ -0,0 +1,373 @@
+/* File: htable-bench.c
+
+   Copyright (c) 2018 David Hauweele <david@hauweele.net>
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the University nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+   OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+   SUCH DAMAGE. */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <err.h>
+
+#include "arena.h"
+#include "htable.h"
+
+/* Benchmark of htable with integer, pointer and path keys. For each hash
+   function and number of entries this reports the time per operation,
+   the probe lengths and the memory used per entry. */
+
+enum key_type { K_INT, K_PTR, K_PATH };
+
+struct hash_func {
+  const char *name;
+  uint32_t (*hash)(const void *);
+};
+
+/* Integer hashes, also used for pointers. */
+static uint32_t knuth_hash(const void *key)
+{
+  return (uintptr_t)key * 0x9e3779b1;
+}
+
+/* Murmur3 64-bit finalizer */
+static uint32_t murmur_hash(const void *key)
+{
+  uint64_t h = (uintptr_t)key;
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return h;
+}
+
+/* Knuth's hash on the high bits of the product */
+static uint32_t fibonacci_hash(const void *key)
+{
+  return ((uint64_t)(uintptr_t)key * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+/* String hashes */
+static uint32_t x31_hash(const void *key)
+{
+  const unsigned char *s = key;
+  uint32_t h = 0;
+
+  for(; *s ; s++)
+    h = h * 31 + *s;
+
+  return h;
+}
+
+static uint32_t fnv_hash(const void *key)
+{
+  const unsigned char *s = key;
+  uint32_t h = 0x811c9dc5;
+
+  for(; *s ; s++) {
+    h ^= *s;
+    h *= 0x01000193;
+  }
+
+  return h;
+}
+
+static uint32_t murmur_str_hash(const void *key)
+{
+  const unsigned char *s = key;
+  size_t len = strlen(key);
+  uint32_t h = 0;
+  size_t i;
+
+  for(i = 0 ; i + 4 <= len ; i += 4) {
+    uint32_t k;
+
+    memcpy(&k, s + i, 4);
+    k *= 0xcc9e2d51;
+    k  = (k << 15) | (k >> 17);
+    k *= 0x1b873593;
+    h ^= k;
+    h  = (h << 13) | (h >> 19);
+    h  = h * 5 + 0xe6546b64;
+  }
+
+  if(len & 3) {
+    uint32_t k = 0;
+
+    memcpy(&k, s + i, len & 3);
+    k *= 0xcc9e2d51;
+    k  = (k << 15) | (k >> 17);
+    k *= 0x1b873593;
+    h ^= k;
+  }
+
+  h ^= len;
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+
+  return h;
+}
+
+static const struct hash_func int_hashes[] = {
+  { "knuth",     knuth_hash },
+  { "fibonacci", fibonacci_hash },
+  { "murmur3",   murmur_hash },
+  { NULL, NULL }
+};
+
+static const struct hash_func str_hashes[] = {
+  { "x31",     x31_hash },
+  { "fnv1a",   fnv_hash },
+  { "murmur3", murmur_str_hash },
+  { NULL, NULL }
+};
+
+static bool id_cmp(const void *k1, const void *k2)
+{
+  return k1 == k2;
+}
+
+static bool str_cmp(const void *k1, const void *k2)
+{
+  return !strcmp(k1, k2);
+}
+
+static void * never_retrieve(const void *key, void *optarg)
+{
+  (void)optarg;
+  errx(1, "entry %p not found", key);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t xorshift(uint64_t *state)
+{
+  uint64_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+
+  return *state = x;
+}
+
+static void shuffle(const void **keys, unsigned long n)
+{
+  uint64_t state = 88172645463325252ULL;
+  unsigned long i;
+
+  for(i = n - 1 ; i > 0 ; i--) {
+    unsigned long j = xorshift(&state) % (i + 1);
+    const void *swap = keys[i];
+    keys[i] = keys[j];
+    keys[j] = swap;
+  }
+}
+
+/* Generate n present keys followed by n absent keys. */
+static const void ** make_keys(enum key_type type, unsigned long n,
+                               arena_t arena)
+{
+  const void **keys = malloc(2 * n * sizeof(void *));
+  unsigned long i;
+
+  if(!keys)
+    err(1, "malloc");
+
+  for(i = 0 ; i < 2 * n ; i++) {
+    char path[64];
+
+    switch(type) {
+    case K_INT:
+      keys[i] = (const void *)(uintptr_t)(i + 1); /* never NULL */
+      break;
+    case K_PTR:
+      /* like struct pointers as keys */
+      keys[i] = arena_alloc(arena, 32);
+      break;
+    case K_PATH:
+      sprintf(path, "/usr/src/project%lu/module%lu/file%lu.c",
+              i % 97, i / 97 % 1013, i);
+      keys[i] = arena_strdup(arena, path);
+      break;
+    }
+
+    if(!keys[i] && type != K_INT)
+      err(1, "arena");
+  }
+
+  return keys;
+}
+
+static double ns_per_op(double start, unsigned long n)
+{
+  return (now() - start) * 1e9 / n;
+}
+
+static void bench(const char *type_name, const struct hash_func *hash,
+                  bool (*compare)(const void *, const void *),
+                  const void **keys, unsigned long n)
+{
+  const void **order = malloc(n * sizeof(void *));
+  struct ht_stats stats;
+  double insert, hit, miss, delete;
+  unsigned long i;
+  double start;
+  htable_t ht;
+
+  if(!order)
+    err(1, "malloc");
+
+  ht = ht_create(16, hash->hash, compare, NULL);
+  if(!ht)
+    err(1, "ht_create");
+
+  start = now();
+  for(i = 0 ; i < n ; i++)
+    ht_search(ht, keys[i], (void *)keys[i]);
+  insert = ns_per_op(start, n);
+
+  ht_stats(ht, &stats);
+
+  /* lookup the present keys in a random order */
+  memcpy(order, keys, n * sizeof(void *));
+  shuffle(order, n);
+  start = now();
+  for(i = 0 ; i < n ; i++)
+    if(ht_lookup(ht, order[i], never_retrieve, NULL) != order[i])
+      errx(1, "wrong data");
+  hit = ns_per_op(start, n);
+
+  start = now();
+  for(i = 0 ; i < n ; i++)
+    if(ht_search(ht, keys[n + i], NULL))
+      errx(1, "unexpected entry");
+  miss = ns_per_op(start, n);
+
+  start = now();
+  for(i = 0 ; i < n ; i++)
+    ht_delete(ht, order[i]);
+  delete = ns_per_op(start, n);
+
+  ht_destroy(ht);
+  free(order);
+
+  printf("%-5s %-10s %9lu %8.1f %8.1f %8.1f %8.1f %7.2f %6u %7.1f\n",
+         type_name, hash->name, n, insert, hit, miss, delete,
+         stats.mean_probe, stats.max_probe,
+         (double)stats.memory / stats.count);
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-t int|ptr|path] [-m min] [-n max]\n"
+                  "Entries go from min (default 1000) to max (default"
+                  " 1000000) by powers of ten.\n", name);
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  static const char *type_names[] = { "int", "ptr", "path" };
+  unsigned long min = 1000, max = 1000000;
+  int only = -1;
+  int type;
+  int c;
+
+  while((c = getopt(argc, argv, "t:m:n:h")) != -1) {
+    switch(c) {
+    case 't':
+      for(only = 0 ; only <= K_PATH ; only++)
+        if(!strcmp(optarg, type_names[only]))
+          break;
+      if(only > K_PATH)
+        usage(argv[0]);
+      break;
+    case 'm':
+      min = strtoul(optarg, NULL, 0);
+      break;
+    case 'n':
+      max = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if(!min || min > max)
+    usage(argv[0]);
+
+  printf("%-5s %-10s %9s %8s %8s %8s %8s %7s %6s %7s\n",
+         "keys", "hash", "entries", "insert", "hit", "miss", "delete",
+         "probe", "max", "B/entry");
+
+  for(type = K_INT ; type <= K_PATH ; type++) {
+    const struct hash_func *hashes = type == K_PATH ? str_hashes
+                                                    : int_hashes;
+    bool (*compare)(const void *, const void *) = type == K_PATH ? str_cmp
+                                                                 : id_cmp;
+    unsigned long n;
+
+    if(only >= 0 && type != only)
+      continue;
+
+    for(n = min ; n <= max ; n *= 10) {
+      arena_t arena = arena_create(1 << 20);
+      const void **keys;
+      const struct hash_func *hash;
+
+      if(!arena)
+        err(1, "arena_create");
+      keys = make_keys(type, n, arena);
+
+      for(hash = hashes ; hash->name ; hash++)
+        bench(type_names[type], hash, compare, keys, n);
+
+      free(keys);
+      arena_destroy(arena);
+    }
+  }
+
+  return 0;
+}
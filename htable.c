@@ -32,15 +32,26 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "arena.h"
 #include "htable.h"
 
-#define IDX(hash, size) hash & (size - 1)
+/* Smallest number of slots in the table. */
+#define MIN_SIZE 8
 
-struct entry {
+/* The table grows when it is more than 7/8 full. */
+#define MAX_LOAD(size) ((size) - ((size) >> 3))
+
+/* Distance of a slot from the position where its hash should be. */
+#define DIST(hash, pos, mask) (((pos) - (hash)) & (mask))
+
+/* The table uses open addressing with Robin Hood hashing. Each slot
+   stores its hash, which is never zero for a used slot, so that most
+   mismatches are rejected without calling the compare function. Keys
+   and data are stored inline, there is no allocation per entry. */
+struct slot {
+  uint32_t hash;
   const void *key;
   void *data;
-
-  struct entry *next;
 };
 
 struct htable {
@@ -48,24 +59,125 @@ struct htable {
   bool (*compare)(const void *, const void *);
   void (*destroy)(void *);
 
-  unsigned int nbuckets;
+  unsigned int size;  /* always a power of two */
+  unsigned int count;
 
-  struct entry *buckets[];
+  struct slot *slots;
+
+  /* storage for the keys and data owned by the table */
+  arena_t arena;
 };
 
+/* zero marks empty slots */
+#define SLOT_HASH(hash) ((hash) ? (hash) : 1)
+
+static struct slot * find(const struct htable *ht, const void *key,
+                          uint32_t hash)
+{
+  unsigned int mask = ht->size - 1;
+  unsigned int pos  = hash & mask;
+  unsigned int dist;
+
+  /* Stop as soon as we reach a slot closer to its home than we are
+     from ours, the key would have taken its place otherwise. */
+  for(dist = 0 ;; dist++, pos = (pos + 1) & mask) {
+    struct slot *slot = &ht->slots[pos];
+
+    if(!slot->hash || DIST(slot->hash, pos, mask) < dist)
+      return NULL;
+    if(slot->hash == hash && ht->compare(slot->key, key))
+      return slot;
+  }
+}
+
+/* Insert an entry known to be absent in a table with a free slot. */
+static void insert(struct htable *ht, uint32_t hash,
+                   const void *key, void *data)
+{
+  struct slot entry = { .hash = hash, .key = key, .data = data };
+  unsigned int mask = ht->size - 1;
+  unsigned int pos  = hash & mask;
+  unsigned int dist = 0;
+
+  for(;; dist++, pos = (pos + 1) & mask) {
+    struct slot *slot = &ht->slots[pos];
+    unsigned int slot_dist;
+
+    if(!slot->hash) {
+      *slot = entry;
+      ht->count++;
+      return;
+    }
+
+    /* take from the rich */
+    slot_dist = DIST(slot->hash, pos, mask);
+    if(slot_dist < dist) {
+      struct slot swap = *slot;
+      *slot = entry;
+      entry = swap;
+      dist  = slot_dist;
+    }
+  }
+}
+
+static int grow(struct htable *ht)
+{
+  struct slot *old = ht->slots;
+  unsigned int size = ht->size;
+  unsigned int i;
+
+  ht->slots = calloc(size * 2, sizeof(struct slot));
+  if(!ht->slots) {
+    ht->slots = old;
+    return -1;
+  }
+  ht->size  = size * 2;
+  ht->count = 0;
+
+  for(i = 0 ; i < size ; i++)
+    if(old[i].hash)
+      insert(ht, old[i].hash, old[i].key, old[i].data);
+
+  free(old);
+  return 0;
+}
+
+/* Ensure that there is room for one more entry. */
+static int reserve(struct htable *ht)
+{
+  if(ht->count + 1 <= MAX_LOAD(ht->size))
+    return 0;
+
+  /* still usable when we cannot grow */
+  if(grow(ht) < 0 && ht->count + 1 >= ht->size)
+    return -1;
+
+  return 0;
+}
+
 htable_t ht_create(unsigned int nbuckets,
                    uint32_t (*hash)(const void *),
                    bool (*compare)(const void *, const void *),
                    void (*destroy)(void *))
 {
-  struct htable *ht = malloc(sizeof(struct htable) +            \
-                             sizeof(struct entry) * nbuckets);
+  struct htable *ht = malloc(sizeof(struct htable));
+  unsigned int size = MIN_SIZE;
 
   if(!ht)
     return NULL;
-  memset(ht, 0, sizeof(struct htable) + sizeof(struct entry *) * nbuckets);
 
-  ht->nbuckets = nbuckets;
+  while(size < nbuckets)
+    size <<= 1;
+
+  ht->slots = calloc(size, sizeof(struct slot));
+  if(!ht->slots) {
+    free(ht);
+    return NULL;
+  }
+
+  ht->size  = size;
+  ht->count = 0;
+  ht->arena = NULL;
 
   ht->hash    = hash;
   ht->compare = compare;
@@ -76,109 +188,153 @@ htable_t ht_create(unsigned int nbuckets,
 
 void * ht_search(htable_t ht, const void *key, void *data)
 {
-  struct entry *entry;
-  uint32_t index    = IDX(ht->hash(key), ht->nbuckets);
-
-  for(entry = ht->buckets[index] ; entry ; entry = entry->next) {
-    if(ht->compare(entry->key, key)) {
-      if(data) {
-        ht->destroy(entry->data);
-        entry->key  = key;
-        entry->data = data;
-      }
-
-      return entry->data;
-    }
-  }
+  return ht_search_hash(ht, ht->hash(key), key, data);
+}
 
-  if(data) {
-    struct entry *new = malloc(sizeof(struct entry));
+void * ht_search_hash(htable_t ht, uint32_t hash, const void *key, void *data)
+{
+  struct slot *slot;
 
-    new->key  = key;
-    new->data = data;
-    new->next = ht->buckets[index];
+  hash = SLOT_HASH(hash);
+  slot = find(ht, key, hash);
 
-    ht->buckets[index] = new;
+  if(slot) {
+    if(data) {
+      if(ht->destroy)
+        ht->destroy(slot->data);
+      slot->key  = key;
+      slot->data = data;
+    }
 
-    return data;
+    return slot->data;
+  }
+
+  if(data) {
+    if(reserve(ht) < 0)
+      return NULL;
+    insert(ht, hash, key, data);
   }
 
-  return NULL;
+  return data;
 }
 
 void * ht_lookup(htable_t ht, const void *key,
                  void *(retrieve)(const void *, void *),
                  void *optarg)
 {
-  struct entry *entry;
-  uint32_t index    = IDX(ht->hash(key), ht->nbuckets);
+  return ht_lookup_hash(ht, ht->hash(key), key, retrieve, optarg);
+}
+
+void * ht_lookup_hash(htable_t ht, uint32_t hash, const void *key,
+                      void *(retrieve)(const void *, void *),
+                      void *optarg)
+{
+  struct slot *slot;
+  void *data;
 
-  for(entry = ht->buckets[index] ; entry ; entry = entry->next)
-    if(ht->compare(entry->key, key))
-      return entry->data;
+  hash = SLOT_HASH(hash);
+  slot = find(ht, key, hash);
 
-  entry = malloc(sizeof(struct entry));
-  entry->key  = key;
-  entry->data = retrieve(key, optarg);
-  entry->next = ht->buckets[index];
+  if(slot)
+    return slot->data;
 
-  ht->buckets[index] = entry;
+  data = retrieve(key, optarg);
 
-  return entry->data;
+  if(reserve(ht) < 0)
+    return data;
+  insert(ht, hash, key, data);
+
+  return data;
 }
 
 void ht_walk(htable_t ht, void (*action)(void *))
 {
   unsigned int i;
 
-  for(i = 0 ; i < ht->nbuckets ; i++) {
-    struct entry *entry;
-
-    for(entry = ht->buckets[i] ; entry ; entry = entry->next)
-      action(entry->data);
-  }
+  for(i = 0 ; i < ht->size ; i++)
+    if(ht->slots[i].hash)
+      action(ht->slots[i].data);
 }
 
 void ht_delete(htable_t ht, const void *key)
 {
-  struct entry *entry;
-  struct entry *prev = NULL;
-  uint32_t index     = IDX(ht->hash(key), ht->nbuckets);
-
-  for(entry = ht->buckets[index], prev = NULL ;
-      entry ;
-      prev = entry, entry = entry->next)
-    if(ht->compare(entry->key, key))
-      break;
+  ht_delete_hash(ht, ht->hash(key), key);
+}
+
+void ht_delete_hash(htable_t ht, uint32_t hash, const void *key)
+{
+  struct slot *slot = find(ht, key, SLOT_HASH(hash));
+  unsigned int mask = ht->size - 1;
+  unsigned int pos;
 
-  if(!entry)
+  if(!slot)
     return;
 
-  if(!prev)
-    ht->buckets[index] = entry->next;
-  else
-    prev->next = entry->next;
+  if(ht->destroy)
+    ht->destroy(slot->data);
+  ht->count--;
+
+  /* Shift the following entries back so that
+     no tombstone is needed. */
+  pos = slot - ht->slots;
+  for(;;) {
+    unsigned int next = (pos + 1) & mask;
+    struct slot *entry = &ht->slots[next];
 
-  ht->destroy(entry->data);
-  free(entry);
+    if(!entry->hash || !DIST(entry->hash, next, mask))
+      break;
+
+    ht->slots[pos] = *entry;
+    pos = next;
+  }
+
+  ht->slots[pos].hash = 0;
 }
 
-void ht_destroy(htable_t ht)
+void ht_stats(htable_t ht, struct ht_stats *stats)
 {
+  unsigned int mask = ht->size - 1;
+  unsigned long total = 0;
   unsigned int i;
 
-  for(i = 0 ; i < ht->nbuckets ; i++) {
-    struct entry *entry = ht->buckets[i];
+  stats->size      = ht->size;
+  stats->count     = ht->count;
+  stats->max_probe = 0;
+  stats->memory    = sizeof(struct htable) + ht->size * sizeof(struct slot);
 
-    while(entry) {
-      struct entry *f = entry;
+  for(i = 0 ; i < ht->size ; i++) {
+    unsigned int probe;
 
-      entry = entry->next;
-      ht->destroy(f->data);
-      free(f);
-    }
+    if(!ht->slots[i].hash)
+      continue;
+
+    probe  = DIST(ht->slots[i].hash, i, mask) + 1;
+    total += probe;
+    if(probe > stats->max_probe)
+      stats->max_probe = probe;
   }
 
-  free(ht);
+  stats->mean_probe = ht->count ? (double)total / ht->count : 0;
+}
+
+arena_t ht_arena(htable_t ht)
+{
+  if(!ht->arena)
+    ht->arena = arena_create(0);
+  return ht->arena;
 }
 
+void ht_destroy(htable_t ht)
+{
+  unsigned int i;
+
+  if(ht->destroy)
+    for(i = 0 ; i < ht->size ; i++)
+      if(ht->slots[i].hash)
+        ht->destroy(ht->slots[i].data);
+
+  if(ht->arena)
+    arena_destroy(ht->arena);
+  free(ht->slots);
+  free(ht);
+}
@@ -32,16 +32,21 @@
 
 #include <stdint.h>
 
+#include "arena.h"
+
 typedef struct htable * htable_t;
 
-/* Create a new hash table. The number of buckets should
-   be a power of two. The hash function take the key
+/* Create a new hash table. The table grows automatically,
+   nbuckets is only the initial number of slots and is rounded
+   up to a power of two. The hash function take the key
    and return a 32 bit hash. Comparison is done on key and
    return true if they are equals, false otherwise. And the
    last function destroy data when necessary. It should be
    used to destroy the key too as long as it is stored
    with the data (for example inside a structure). Not useful
-   though when the key is only an integer. */
+   though when the key is only an integer. It may be NULL when
+   there is nothing to destroy, for example when the entries
+   are allocated in the arena of the table. */
 htable_t ht_create(unsigned int nbuckets,
                    uint32_t (*hash)(const void *),
                    bool (*compare)(const void *, const void *),
@@ -79,6 +84,34 @@ void ht_walk(htable_t htable, void (*action)(void *));
    the data and the key if necessary. */
 void ht_delete(htable_t htable, const void *key);
 
+/* Same as ht_search(), ht_lookup() and ht_delete() with the hash of
+   the key already computed by the caller with the hash function of
+   the table. This avoids hashing the key twice when the caller needs
+   the hash too, for example to select one table among several. */
+void * ht_search_hash(htable_t htable, uint32_t hash,
+                      const void *key, void *data);
+void * ht_lookup_hash(htable_t htable, uint32_t hash, const void *key,
+                      void *(retrieve)(const void *, void *),
+                      void *optarg);
+void ht_delete_hash(htable_t htable, uint32_t hash, const void *key);
+
+struct ht_stats {
+  unsigned int size;   /* number of slots */
+  unsigned int count;  /* number of entries */
+  unsigned int max_probe;
+  double mean_probe;   /* slots examined to find an entry */
+  size_t memory;       /* bytes used by the table, arena excluded */
+};
+
+/* Fill stats with the occupancy and probe lengths of the table. */
+void ht_stats(htable_t htable, struct ht_stats *stats);
+
+/* Return the arena owned by the hash table, creating it if needed.
+   Keys and data allocated there live as long as the table and are
+   released at once when it is destroyed, without calling the destroy
+   function on each entry. Return NULL when out of memory. */
+arena_t ht_arena(htable_t htable);
+
 /* Destroy each entry from the hash table and then destroy
    the hash table itself. */
 void ht_destroy(htable_t htable);
@@ -0,0 +1,321 @@
+/* Copyright (c) 2018, David Hauweele <david@hauweele.net>
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this
+       list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+   ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "idcache.h"
+
+/* Ids below this value are stored in a dense array. This covers the
+   system and regular accounts on most systems. */
+#define DENSE_IDS 4096
+
+/* Initial number of slots for the other ids. */
+#define SPARSE_SIZE 16
+
+struct sparse {
+  unsigned long id;
+  const char *name; /* NULL when the slot is empty */
+};
+
+/* reverse index from names to ids */
+struct reverse {
+  uint32_t hash;
+  unsigned long id;
+  const char *name; /* NULL when the slot is empty */
+};
+
+struct idcache {
+  const char * (*retrieve)(unsigned long id);
+
+  /* other ids in a linear probing table */
+  struct sparse *sparse;
+  unsigned int sparse_size;
+  unsigned int sparse_count;
+
+  struct reverse *reverse;
+  unsigned int reverse_size;
+  unsigned int reverse_count;
+
+  arena_t names;
+
+  const char *dense[DENSE_IDS];
+};
+
+static uint32_t hash_id(unsigned long id)
+{
+  return (uint32_t)id * 0x9e3779b1;
+}
+
+/* FNV-1a */
+static uint32_t hash_name(const char *name)
+{
+  uint32_t hash = 0x811c9dc5;
+
+  for(; *name ; name++) {
+    hash ^= (unsigned char)*name;
+    hash *= 0x01000193;
+  }
+
+  return hash;
+}
+
+static struct reverse * reverse_slot(struct reverse *reverse,
+                                     unsigned int size,
+                                     const char *name, uint32_t hash)
+{
+  unsigned int mask = size - 1;
+  unsigned int pos  = hash & mask;
+
+  while(reverse[pos].name && (reverse[pos].hash != hash ||
+                              strcmp(reverse[pos].name, name)))
+    pos = (pos + 1) & mask;
+
+  return &reverse[pos];
+}
+
+static int reverse_grow(struct idcache *cache)
+{
+  unsigned int size = cache->reverse_size ? cache->reverse_size * 2
+                                          : SPARSE_SIZE;
+  struct reverse *reverse = calloc(size, sizeof(struct reverse));
+  unsigned int i;
+
+  if(!reverse)
+    return -1;
+
+  for(i = 0 ; i < cache->reverse_size ; i++) {
+    struct reverse *entry = &cache->reverse[i];
+    if(entry->name)
+      *reverse_slot(reverse, size, entry->name, entry->hash) = *entry;
+  }
+
+  free(cache->reverse);
+  cache->reverse      = reverse;
+  cache->reverse_size = size;
+
+  return 0;
+}
+
+/* Index an interned name. The first id registered for a name wins. */
+static int index_name(struct idcache *cache, const char *name,
+                      unsigned long id)
+{
+  uint32_t hash = hash_name(name);
+  struct reverse *slot;
+
+  if(2 * (cache->reverse_count + 1) > cache->reverse_size &&
+     reverse_grow(cache) < 0)
+    return -1;
+
+  slot = reverse_slot(cache->reverse, cache->reverse_size, name, hash);
+  if(slot->name)
+    return 0;
+
+  slot->hash = hash;
+  slot->id   = id;
+  slot->name = name;
+  cache->reverse_count++;
+
+  return 0;
+}
+
+static const char * retrieve(struct idcache *cache, unsigned long id)
+{
+  const char *name = cache->retrieve(id);
+  char buf[32];
+
+  if(name) {
+    name = arena_strdup(cache->names, name);
+    if(name && index_name(cache, name, id) < 0)
+      return NULL;
+    return name;
+  }
+
+  /* In case something goes wrong we use the id as name */
+  snprintf(buf, sizeof(buf), "%lu", id);
+  return arena_strdup(cache->names, buf);
+}
+
+static struct sparse * sparse_slot(struct sparse *sparse, unsigned int size,
+                                   unsigned long id)
+{
+  unsigned int mask = size - 1;
+  unsigned int pos  = hash_id(id) & mask;
+
+  while(sparse[pos].name && sparse[pos].id != id)
+    pos = (pos + 1) & mask;
+
+  return &sparse[pos];
+}
+
+static int sparse_grow(struct idcache *cache)
+{
+  unsigned int size = cache->sparse_size ? cache->sparse_size * 2
+                                         : SPARSE_SIZE;
+  struct sparse *sparse = calloc(size, sizeof(struct sparse));
+  unsigned int i;
+
+  if(!sparse)
+    return -1;
+
+  for(i = 0 ; i < cache->sparse_size ; i++)
+    if(cache->sparse[i].name)
+      *sparse_slot(sparse, size, cache->sparse[i].id) = cache->sparse[i];
+
+  free(cache->sparse);
+  cache->sparse      = sparse;
+  cache->sparse_size = size;
+
+  return 0;
+}
+
+/* Return the location of the name of id, which is NULL
+   when the id is not cached yet. */
+static const char ** name_slot(struct idcache *cache, unsigned long id)
+{
+  struct sparse *slot;
+
+  if(id < DENSE_IDS)
+    return &cache->dense[id];
+
+  if(cache->sparse_size) {
+    slot = sparse_slot(cache->sparse, cache->sparse_size, id);
+    if(slot->name)
+      return &slot->name;
+  }
+
+  /* keep the table at most half full */
+  if(2 * (cache->sparse_count + 1) > cache->sparse_size &&
+     sparse_grow(cache) < 0)
+    return NULL;
+
+  slot = sparse_slot(cache->sparse, cache->sparse_size, id);
+  slot->id = id;
+
+  return &slot->name;
+}
+
+/* Store the name of id in the location returned by name_slot(). Sparse
+   entries are only counted once filled, a failed retrieve leaves the
+   slot empty. */
+static const char * fill_slot(struct idcache *cache, unsigned long id,
+                              const char **slot, const char *name)
+{
+  *slot = name;
+  if(name && id >= DENSE_IDS)
+    cache->sparse_count++;
+
+  return name;
+}
+
+idcache_t idcache_create(const char * (*retrieve)(unsigned long id))
+{
+  struct idcache *cache = calloc(1, sizeof(struct idcache));
+
+  if(!cache)
+    return NULL;
+
+  cache->retrieve = retrieve;
+  cache->names    = arena_create(0);
+  if(!cache->names) {
+    free(cache);
+    return NULL;
+  }
+
+  return cache;
+}
+
+const char * idcache_lookup(idcache_t cache, unsigned long id)
+{
+  const char **name;
+
+  /* fast path */
+  if(id < DENSE_IDS && cache->dense[id])
+    return cache->dense[id];
+
+  name = name_slot(cache, id);
+  if(!name)
+    return NULL;
+  if(!*name)
+    fill_slot(cache, id, name, retrieve(cache, id));
+
+  return *name;
+}
+
+int idcache_insert(idcache_t cache, unsigned long id, const char *name)
+{
+  const char **slot = name_slot(cache, id);
+
+  if(!slot)
+    return -1;
+
+  /* An alias of an id already cached keeps the first name for lookups
+     but its own name still resolves to the id. */
+  if(*slot) {
+    const char *alias;
+    unsigned long known;
+
+    if(!idcache_id(cache, name, &known))
+      return 0;
+
+    alias = arena_strdup(cache->names, name);
+    if(!alias)
+      return -1;
+
+    return index_name(cache, alias, id);
+  }
+
+  if(!fill_slot(cache, id, slot, arena_strdup(cache->names, name)))
+    return -1;
+
+  return index_name(cache, *slot, id);
+}
+
+int idcache_id(idcache_t cache, const char *name, unsigned long *id)
+{
+  struct reverse *slot;
+
+  if(!cache->reverse_size)
+    return -1;
+
+  slot = reverse_slot(cache->reverse, cache->reverse_size,
+                      name, hash_name(name));
+  if(!slot->name)
+    return -1;
+
+  *id = slot->id;
+  return 0;
+}
+
+void idcache_destroy(idcache_t cache)
+{
+  arena_destroy(cache->names);
+  free(cache->sparse);
+  free(cache->reverse);
+  free(cache);
+}
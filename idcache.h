@@ -0,0 +1,54 @@
+/* Copyright (c) 2018, David Hauweele <david@hauweele.net>
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this
+       list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+   ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _IDCACHE_H_
+#define _IDCACHE_H_
+
+typedef struct idcache * idcache_t;
+
+/* Create a cache mapping numeric ids (uid, gid) to names. The retrieve
+   function returns the name associated to an id or NULL when the id has
+   none, in which case the id itself in decimal is used. The returned
+   name is copied in the cache. */
+idcache_t idcache_create(const char * (*retrieve)(unsigned long id));
+
+/* Return the name associated to id. The retrieve function is only called
+   the first time an id is requested. The name remains valid until the
+   cache is destroyed. */
+const char * idcache_lookup(idcache_t cache, unsigned long id);
+
+/* Add the name of an id to the cache, for example when the whole user
+   database is loaded at once. An id already in the cache keeps its name
+   but the new name is still indexed for idcache_id(), as for aliases
+   sharing the same uid. Return a negative value on error. */
+int idcache_insert(idcache_t cache, unsigned long id, const char *name);
+
+/* Find the id associated to name among the names in the cache. Return
+   zero and store the id when found, a negative value otherwise. */
+int idcache_id(idcache_t cache, const char *name, unsigned long *id);
+
+/* Destroy the cache and all the names it contains. */
+void idcache_destroy(idcache_t cache);
+
+#endif /* _IDCACHE_H_ */
@@ -0,0 +1,695 @@
+/* File: iobuf-test.c
+
+   Copyright (c) 2018 David Hauweele <david@hauweele.net>
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the University nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+   OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+   SUCH DAMAGE. */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include "iobuf.h"
+
+/* Regression tests for the iobuf modes. Each test works on a temporary
+   file and reports the checks that failed. */
+
+static unsigned int failures;
+
+#define CHECK(cond) do {                                     \
+    if(!(cond)) {                                            \
+      warnx("%s:%d: %s", __func__, __LINE__, #cond);         \
+      failures++;                                            \
+    }                                                        \
+  } while(0)
+
+/* Calls to writev() from iobuf end up here. Each call may be limited
+   to a few bytes to exercise short writes as the kernel may do them. */
+static size_t writev_limit;
+static unsigned int writev_calls;
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+  struct iovec vec[iovcnt];
+  size_t left = writev_limit;
+  int n;
+
+  writev_calls++;
+  if(!writev_limit)
+    return syscall(SYS_writev, fd, iov, iovcnt);
+
+  for(n = 0 ; n < iovcnt && left ; n++) {
+    vec[n] = iov[n];
+    if(vec[n].iov_len > left)
+      vec[n].iov_len = left;
+    left -= vec[n].iov_len;
+  }
+
+  return syscall(SYS_writev, fd, vec, n);
+}
+
+/* Create a temporary file with the specified content. */
+static int temp_file(const char *content, size_t size)
+{
+  char path[] = "/tmp/iobuf-test.XXXXXX";
+  int fd = mkstemp(path);
+
+  if(fd < 0)
+    err(1, "mkstemp");
+  unlink(path);
+
+  if(size && write(fd, content, size) != (ssize_t)size)
+    err(1, "write");
+  if(lseek(fd, 0, SEEK_SET) < 0)
+    err(1, "lseek");
+
+  return fd;
+}
+
+/* Check that the file contains exactly size bytes of content. */
+static int file_equals(int fd, const char *content, size_t size)
+{
+  char *buf = malloc(size + 1);
+  ssize_t n;
+  int ret;
+
+  if(!buf)
+    err(1, "malloc");
+
+  n   = pread(fd, buf, size + 1, 0);
+  ret = n == (ssize_t)size && !memcmp(buf, content, size);
+  free(buf);
+
+  return ret;
+}
+
+/* Size of the file behind the descriptor. */
+static off_t file_size(int fd)
+{
+  struct stat st;
+
+  if(fstat(fd, &st) < 0)
+    err(1, "fstat");
+
+  return st.st_size;
+}
+
+/* The write buffers are exchanged on each flush in asynchronous mode,
+   the stream must be closed after an odd and an even number of them. */
+static void test_async_write(void)
+{
+  static const char big[10000] = { 'x' };
+  unsigned int flushes;
+
+  for(flushes = 0 ; flushes < 4 ; flushes++) {
+    int fd = temp_file(NULL, 0);
+    int copy = dup(fd);
+    iofile_t file = iobuf_dopen_sized(fd, 4096, 4096, IOBUF_ASYNC);
+    char expected[sizeof(big) + 64];
+    size_t size = 0;
+    unsigned int i;
+
+    CHECK(file != NULL);
+    if(!file)
+      continue;
+
+    for(i = 0 ; i < flushes ; i++) {
+      CHECK(iobuf_write(file, "line\n", 5) == 5);
+      CHECK(iobuf_flush(file) == 0);
+      memcpy(expected + size, "line\n", 5);
+      size += 5;
+    }
+
+    /* larger than the buffer */
+    CHECK(iobuf_write(file, big, sizeof(big)) == sizeof(big));
+    memcpy(expected + size, big, sizeof(big));
+    size += sizeof(big);
+
+    CHECK(iobuf_write(file, "end\n", 4) == 4);
+    memcpy(expected + size, "end\n", 4);
+    size += 4;
+
+    CHECK(iobuf_close(file) == 0);
+    CHECK(file_equals(copy, expected, size));
+    close(copy);
+  }
+}
+
+/* Nothing is mapped before the first read in mmap mode. */
+static void test_mmap_first_read(void)
+{
+  static const char content[] = "first\nsecond\n";
+  const char *line;
+  iofile_t file;
+  char buf[64];
+
+  file = iobuf_dopen_sized(temp_file(content, sizeof(content) - 1),
+                           0, 0, IOBUF_MMAP);
+  CHECK(iobuf_getline(file, &line) == 6 && !memcmp(line, "first\n", 6));
+  CHECK(iobuf_getline(file, &line) == 7 && !memcmp(line, "second\n", 7));
+  CHECK(iobuf_getline(file, &line) == 0);
+  iobuf_close(file);
+
+  file = iobuf_dopen_sized(temp_file(content, sizeof(content) - 1),
+                           0, 0, IOBUF_MMAP);
+  CHECK(iobuf_gets(file, buf, sizeof(buf)) == 6 && !strcmp(buf, "first\n"));
+  iobuf_close(file);
+
+  /* empty file */
+  file = iobuf_dopen_sized(temp_file(NULL, 0), 0, 0, IOBUF_MMAP);
+  CHECK(iobuf_getline(file, &line) == 0);
+  CHECK(iobuf_gets(file, buf, sizeof(buf)) == 0);
+  iobuf_close(file);
+}
+
+/* Streams in mmap mode are read-only and leave the descriptor at the
+   logical position when closed. */
+static void test_mmap_position(void)
+{
+  static const char content[] = "0123456789";
+  int fd = temp_file(content, sizeof(content) - 1);
+  int copy = dup(fd);
+  iofile_t file = iobuf_dopen_sized(fd, 0, 0, IOBUF_MMAP);
+  char buf[4];
+
+  CHECK(iobuf_read(file, buf, 3) == 3 && !memcmp(buf, "012", 3));
+  errno = 0;
+  CHECK(iobuf_write(file, "x", 1) < 0 && errno == EBADF);
+  CHECK(iobuf_putc('x', file) < 0);
+  CHECK(iobuf_close(file) == 0);
+  CHECK(lseek(copy, 0, SEEK_CUR) == 3);
+  CHECK(file_equals(copy, content, sizeof(content) - 1));
+
+  file = iobuf_dopen_sized(copy, 0, 0, IOBUF_MMAP);
+  CHECK(iobuf_lseek(file, 2, SEEK_CUR) == 5);
+  CHECK(iobuf_getc(file) == '5');
+  CHECK(iobuf_lseek(file, -2, SEEK_END) == 8);
+  CHECK(iobuf_tell(file) == 8);
+  fd = dup(copy);
+  CHECK(iobuf_close(file) == 0);
+  CHECK(lseek(fd, 0, SEEK_CUR) == 8);
+
+  /* The stream is released even if the descriptor cannot be moved,
+     which depends on the maximum file size of the file system. */
+  copy = dup(fd);
+  file = iobuf_dopen_sized(fd, 0, 0, IOBUF_MMAP);
+  CHECK(iobuf_lseek(file, INT64_MAX, SEEK_SET) == INT64_MAX);
+  if(lseek(copy, INT64_MAX, SEEK_SET) < 0) {
+    errno = 0;
+    CHECK(iobuf_close(file) < 0 && errno == EINVAL);
+    CHECK(fcntl(fd, F_GETFD) < 0);
+  }
+  else
+    CHECK(iobuf_close(file) == 0);
+  close(copy);
+}
+
+/* Seeks inside the buffered window do not move the descriptor and
+   iobuf_tell() follows reads, writes and seeks. */
+static void test_seek_window(void)
+{
+  char content[200];
+  char buf[10];
+  iofile_t file;
+  int fd, copy;
+  int i;
+
+  for(i = 0 ; i < (int)sizeof(content) ; i++)
+    content[i] = i;
+
+  fd   = temp_file(content, sizeof(content));
+  copy = dup(fd);
+  file = iobuf_dopen_sized(fd, 64, 0, 0);
+
+  CHECK(iobuf_tell(file) == 0);
+  CHECK(iobuf_read(file, buf, 10) == 10 && buf[9] == 9);
+  CHECK(iobuf_tell(file) == 10);
+  CHECK(lseek(copy, 0, SEEK_CUR) == 64);
+
+  CHECK(iobuf_lseek(file, 3, SEEK_SET) == 3);
+  CHECK(iobuf_getc(file) == 3);
+  CHECK(iobuf_lseek(file, 50, SEEK_CUR) == 54);
+  CHECK(iobuf_getc(file) == 54);
+  CHECK(iobuf_tell(file) == 55);
+  CHECK(iobuf_lseek(file, -55, SEEK_CUR) == 0);
+  CHECK(iobuf_getc(file) == 0);
+  /* the end of the window is still inside */
+  CHECK(iobuf_lseek(file, 64, SEEK_SET) == 64);
+  CHECK(lseek(copy, 0, SEEK_CUR) == 64);
+
+  CHECK(iobuf_getc(file) == 64);
+  CHECK(lseek(copy, 0, SEEK_CUR) == 128);
+
+  /* outside of the window */
+  CHECK(iobuf_lseek(file, 10, SEEK_SET) == 10);
+  CHECK(lseek(copy, 0, SEEK_CUR) == 10);
+  CHECK(iobuf_getc(file) == 10);
+  CHECK(iobuf_tell(file) == 11);
+  CHECK(iobuf_lseek(file, -1, SEEK_END) == 199);
+  CHECK(iobuf_getc(file) == 199);
+  CHECK(iobuf_getc(file) == GETC_EOF);
+  CHECK(iobuf_tell(file) == 200);
+  CHECK(iobuf_close(file) == 0);
+  close(copy);
+
+  /* reads and writes mixed on the same stream */
+  fd   = temp_file("abcdefghij", 10);
+  copy = dup(fd);
+  file = iobuf_dopen_sized(fd, 4, 8, 0);
+
+  CHECK(iobuf_getc(file) == 'a');
+  CHECK(iobuf_tell(file) == 1);
+  CHECK(iobuf_write(file, "X", 1) == 1);
+  CHECK(iobuf_tell(file) == 2);
+  CHECK(iobuf_flush(file) == 0);
+  CHECK(iobuf_tell(file) == 2);
+  CHECK(iobuf_write(file, "YZ", 2) == 2);
+  CHECK(iobuf_tell(file) == 4);
+  CHECK(iobuf_lseek(file, 0, SEEK_CUR) == 4);
+  CHECK(iobuf_getc(file) == 'e');
+  CHECK(iobuf_tell(file) == 5);
+  CHECK(iobuf_close(file) == 0);
+  CHECK(file_equals(copy, "aXYZefghij", 10));
+  close(copy);
+}
+
+/* Relative seeks inside the buffer of a pipe. */
+static void test_pipe_seek(void)
+{
+  iofile_t file;
+  char buf[4];
+  int fds[2];
+
+  if(pipe(fds) < 0)
+    err(1, "pipe");
+  if(write(fds[1], "0123456789", 10) != 10)
+    err(1, "write");
+  close(fds[1]);
+
+  file = iobuf_dopen(fds[0]);
+  CHECK(iobuf_read(file, buf, 4) == 4 && !memcmp(buf, "0123", 4));
+  CHECK(iobuf_lseek(file, -2, SEEK_CUR) == 0);
+  CHECK(iobuf_getc(file) == '2');
+  CHECK(iobuf_lseek(file, 3, SEEK_CUR) == 0);
+  CHECK(iobuf_getc(file) == '6');
+  CHECK(iobuf_lseek(file, -7, SEEK_CUR) == 0);
+  CHECK(iobuf_getc(file) == '0');
+  errno = 0;
+  CHECK(iobuf_lseek(file, -2, SEEK_CUR) < 0 && errno == ESPIPE);
+  errno = 0;
+  CHECK(iobuf_lseek(file, 20, SEEK_CUR) < 0 && errno == ESPIPE);
+  CHECK(iobuf_close(file) == 0);
+}
+
+/* Windows borrowed across refills of a read buffer smaller than the file. */
+static void test_peek_consume(void)
+{
+  static const char content[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+  const char *window;
+  iofile_t file;
+  char buf[4];
+
+  file = iobuf_dopen_sized(temp_file(content, sizeof(content) - 1), 8, 0, 0);
+
+  CHECK(iobuf_peek(file, &window, 3) == 8 && !memcmp(window, "01234567", 8));
+  iobuf_consume(file, 6);
+  CHECK(iobuf_peek(file, &window, 1) == 2 && !memcmp(window, "67", 2));
+
+  /* more than available, the unread bytes are moved to the front */
+  CHECK(iobuf_peek(file, &window, 5) == 8 && !memcmp(window, "6789abcd", 8));
+  iobuf_consume(file, 2);
+
+  /* capped to the size of the buffer */
+  CHECK(iobuf_peek(file, &window, 100) == 8 &&
+        !memcmp(window, "89abcdef", 8));
+
+  /* consuming more than available only consumes what is buffered */
+  iobuf_consume(file, 100);
+  CHECK(iobuf_read(file, buf, 4) == 4 && !memcmp(buf, "ghij", 4));
+
+  /* mixed with the copying functions */
+  CHECK(iobuf_getc(file) == 'k');
+  CHECK(iobuf_peek(file, &window, 1) == 3 && !memcmp(window, "lmn", 3));
+  iobuf_consume(file, 3);
+
+  while(iobuf_peek(file, &window, 1) > 0)
+    iobuf_consume(file, 1);
+  CHECK(iobuf_peek(file, &window, 1) == 0);
+  CHECK(iobuf_tell(file) == sizeof(content) - 1);
+  iobuf_close(file);
+}
+
+/* Lines straddling the end of the buffer, longer than it, and a last
+   line without newline. */
+static void test_getline_refill(void)
+{
+  static const char content[] = "ab\ncdefg\n\nhijklmnopqrst\nuv\nwxyz";
+  static const char *lines[] = { "ab\n", "cdefg\n", "\n", "hijklmno",
+                                 "pqrst\n", "uv\n", "wxyz", NULL };
+  const char **expected;
+  const char *line;
+  iofile_t file;
+
+  file = iobuf_dopen_sized(temp_file(content, sizeof(content) - 1), 8, 0, 0);
+
+  for(expected = lines ; *expected ; expected++) {
+    ssize_t n = iobuf_getline(file, &line);
+
+    CHECK(n == (ssize_t)strlen(*expected) && !memcmp(line, *expected, n));
+  }
+  CHECK(iobuf_getline(file, &line) == 0);
+  CHECK(iobuf_getline(file, &line) == 0);
+  iobuf_close(file);
+}
+
+/* Records terminated by any byte of a set, across buffer refills. */
+static void test_getdelims(void)
+{
+  static const char content[] = "one two,three\nfour";
+  const char *record;
+  iofile_t file;
+
+  /* a read buffer smaller than the records */
+  file = iobuf_dopen_sized(temp_file(content, sizeof(content) - 1), 4, 4, 0);
+  CHECK(iobuf_getdelims(file, &record, " ,\n", 3) == 4 &&
+        !memcmp(record, "one ", 4));
+  CHECK(iobuf_getdelims(file, &record, " ,\n", 3) == 4 &&
+        !memcmp(record, "two,", 4));
+  /* longer than the buffer, split */
+  CHECK(iobuf_getdelims(file, &record, " ,\n", 3) == 4 &&
+        !memcmp(record, "thre", 4));
+  CHECK(iobuf_getdelims(file, &record, " ,\n", 3) == 2 &&
+        !memcmp(record, "e\n", 2));
+  CHECK(iobuf_getdelims(file, &record, " ,\n", 3) == 4 &&
+        !memcmp(record, "four", 4));
+  CHECK(iobuf_getdelims(file, &record, " ,\n", 3) == 0);
+  iobuf_close(file);
+
+  file = iobuf_dopen(temp_file(content, sizeof(content) - 1));
+  CHECK(iobuf_getdelim(file, &record, ',') == 8 &&
+        !memcmp(record, "one two,", 8));
+  CHECK(iobuf_getdelims(file, &record, "\n", 1) == 6 &&
+        !memcmp(record, "three\n", 6));
+  iobuf_close(file);
+}
+
+/* With IOBUF_GROW large records make the write buffer grow instead of
+   being written directly. */
+static void test_grow(void)
+{
+  static const char big[1000] = { 'x' };
+  char expected[10 + 100 + 20 + sizeof(big)];
+  int fd = temp_file(NULL, 0);
+  int copy = dup(fd);
+  iofile_t file = iobuf_dopen_sized(fd, 0, 16, IOBUF_GROW);
+
+  memset(expected, 'a', 10);
+  memcpy(expected + 10, big, 100);
+  memset(expected + 110, 'b', 20);
+  memcpy(expected + 130, big, sizeof(big));
+
+  CHECK(iobuf_write(file, expected, 10) == 10);
+  CHECK(file_size(copy) == 0);
+
+  /* the pending bytes are flushed before growing */
+  CHECK(iobuf_write(file, expected + 10, 100) == 100);
+  CHECK(file_size(copy) == 10);
+
+  /* fits in the grown buffer */
+  CHECK(iobuf_write(file, expected + 110, 20) == 20);
+  CHECK(file_size(copy) == 10);
+
+  CHECK(iobuf_write(file, expected + 130, sizeof(big)) == sizeof(big));
+  CHECK(file_size(copy) == 130);
+  CHECK(iobuf_tell(file) == sizeof(expected));
+
+  CHECK(iobuf_close(file) == 0);
+  CHECK(file_equals(copy, expected, sizeof(expected)));
+  close(copy);
+
+  /* without the flag large records are written at once */
+  fd   = temp_file(NULL, 0);
+  copy = dup(fd);
+  file = iobuf_dopen_sized(fd, 0, 16, 0);
+  CHECK(iobuf_write(file, expected, 10) == 10);
+  CHECK(iobuf_write(file, expected + 10, 100) == 100);
+  CHECK(file_size(copy) == 110);
+  CHECK(iobuf_close(file) == 0);
+  CHECK(file_equals(copy, expected, 110));
+  close(copy);
+}
+
+static void * fill_pipe(void *arg)
+{
+  static const char chunk[4096];
+  int fd = *(int *)arg;
+  int i;
+
+  for(i = 0 ; i < 2 * IOBUF_SIZE / (int)sizeof(chunk) ; i++)
+    if(write(fd, chunk, sizeof(chunk)) != sizeof(chunk))
+      err(1, "write");
+  close(fd);
+
+  return NULL;
+}
+
+/* IOBUF_AUTO never gives less than IOBUF_SIZE, even for small pipes. */
+static void test_auto_size(void)
+{
+  static const char content[3 * IOBUF_SIZE];
+  const char *window;
+  pthread_t writer;
+  iofile_t file;
+  int fds[2];
+
+  file = iobuf_dopen_sized(temp_file(content, sizeof(content)),
+                           IOBUF_AUTO, 0, 0);
+  CHECK(iobuf_peek(file, &window, sizeof(content)) >= IOBUF_SIZE);
+  iobuf_close(file);
+
+  if(pipe(fds) < 0)
+    err(1, "pipe");
+#ifdef F_SETPIPE_SZ
+  if(fcntl(fds[1], F_SETPIPE_SZ, 4096) < 0)
+    warn("F_SETPIPE_SZ");
+#endif /* F_SETPIPE_SZ */
+  if(pthread_create(&writer, NULL, fill_pipe, &fds[1]))
+    errx(1, "cannot create thread");
+
+  file = iobuf_dopen_sized(fds[0], IOBUF_AUTO, 0, 0);
+  CHECK(iobuf_peek(file, &window, 2 * IOBUF_SIZE) == IOBUF_SIZE);
+  while(iobuf_peek(file, &window, 1) > 0)
+    iobuf_consume(file, IOBUF_SIZE);
+  iobuf_close(file);
+  pthread_join(writer, NULL);
+}
+
+/* Records larger than the write buffer are written along with the
+   pending bytes in a single writev(), which may write them partially. */
+static void test_gather_write(void)
+{
+  static const char big[100] = { 'x', 'y', 'z' };
+  struct iovec iov[] = {
+    { .iov_base = (void *)big, .iov_len = 30 },
+    { .iov_base = "",          .iov_len = 0 },
+    { .iov_base = (void *)big, .iov_len = sizeof(big) }
+  };
+  char expected[5 + sizeof(big) + 30 + sizeof(big) + 3];
+  size_t limit;
+
+  memcpy(expected, "head:", 5);
+  memcpy(expected + 5, big, sizeof(big));
+  memcpy(expected + 5 + sizeof(big), big, 30);
+  memcpy(expected + 35 + sizeof(big), big, sizeof(big));
+  memcpy(expected + 35 + 2 * sizeof(big), "end", 3);
+
+  /* without limit, then cutting inside and at the end of each vector */
+  for(limit = 0 ; limit <= 7 ; limit += 7) {
+    int fd = temp_file(NULL, 0);
+    int copy = dup(fd);
+    iofile_t file = iobuf_dopen_sized(fd, 0, 16, 0);
+
+    writev_limit = limit;
+    writev_calls = 0;
+
+    CHECK(iobuf_write(file, "head:", 5) == 5);
+    CHECK(iobuf_write(file, big, sizeof(big)) == sizeof(big));
+    CHECK(file_size(copy) == 5 + sizeof(big));
+    CHECK(iobuf_tell(file) == 5 + sizeof(big));
+    if(!limit)
+      CHECK(writev_calls == 1);
+
+    CHECK(iobuf_writev(file, iov, 3) == 30 + sizeof(big));
+    CHECK(iobuf_write(file, "end", 3) == 3);
+    CHECK(iobuf_tell(file) == sizeof(expected));
+    if(!limit)
+      CHECK(writev_calls == 2);
+    else
+      CHECK(writev_calls > 2);
+
+    CHECK(iobuf_close(file) == 0);
+    CHECK(file_equals(copy, expected, sizeof(expected)));
+    close(copy);
+  }
+
+  writev_limit = 0;
+}
+
+/* The field writers give the same output as printf(), also when the
+   padding is wider than the write buffer. */
+static void test_put_fields(void)
+{
+  char expected[1024];
+  size_t size = 0;
+  int fd = temp_file(NULL, 0);
+  int copy = dup(fd);
+  iofile_t file = iobuf_dopen_sized(fd, 0, 16, 0);
+
+#define FIELD(call, ...) do {                                          \
+    int n = snprintf(expected + size, sizeof(expected) - size,          \
+                     __VA_ARGS__);                                      \
+    CHECK(call == n);                                                   \
+    size += n;                                                          \
+  } while(0)
+
+  FIELD(iobuf_put_udec(file, 0, 0, ' '), "%d", 0);
+  FIELD(iobuf_put_dec(file, 0, 0, ' '), "%d", 0);
+  FIELD(iobuf_put_oct(file, 0, 0, ' '), "%o", 0);
+  FIELD(iobuf_put_udec(file, UINT64_MAX, 0, ' '), "%ju",
+        (uintmax_t)UINT64_MAX);
+  FIELD(iobuf_put_oct(file, UINT64_MAX, 0, ' '), "%jo",
+        (uintmax_t)UINT64_MAX);
+  FIELD(iobuf_put_dec(file, INT64_MIN, 0, ' '), "%jd", (intmax_t)INT64_MIN);
+  FIELD(iobuf_put_dec(file, INT64_MAX, 0, ' '), "%jd", (intmax_t)INT64_MAX);
+
+  /* narrower than the value */
+  FIELD(iobuf_put_udec(file, 12345, 2, ' '), "%2d", 12345);
+  FIELD(iobuf_put_dec(file, -12345, 3, '0'), "%03d", -12345);
+
+  /* padding */
+  FIELD(iobuf_put_dec(file, -42, 6, ' '), "%6d", -42);
+  FIELD(iobuf_put_dec(file, -42, 6, '0'), "%06d", -42);
+  FIELD(iobuf_put_dec(file, -42, -6, ' '), "%-6d", -42);
+  FIELD(iobuf_put_oct(file, 8, 4, '0'), "%04o", 8);
+  FIELD(iobuf_put_str(file, "ab", 5), "%5s", "ab");
+  FIELD(iobuf_put_str(file, "ab", -5), "%-5s", "ab");
+  FIELD(iobuf_put_str(file, "", 0), "%s", "");
+
+  /* wider than the write buffer */
+  FIELD(iobuf_put_udec(file, 7, 40, ' '), "%40d", 7);
+  FIELD(iobuf_put_dec(file, -7, 40, '0'), "%040d", -7);
+  FIELD(iobuf_put_dec(file, INT64_MIN, -40, ' '), "%-40jd",
+        (intmax_t)INT64_MIN);
+  FIELD(iobuf_put_oct(file, UINT64_MAX, 30, '0'), "%030jo",
+        (uintmax_t)UINT64_MAX);
+  FIELD(iobuf_put_str(file, "abc", 40), "%40s", "abc");
+  FIELD(iobuf_put_str(file, "abc", -40), "%-40s", "abc");
+  FIELD(iobuf_put_str(file, "a string longer than the buffer", 0), "%s",
+        "a string longer than the buffer");
+
+#undef FIELD
+
+  CHECK(iobuf_tell(file) == (off_t)size);
+  CHECK(iobuf_close(file) == 0);
+  CHECK(file_equals(copy, expected, size));
+  close(copy);
+}
+
+/* A write size of 0 is IOBUF_AUTO for writable descriptors, while
+   read-only descriptors get no write buffer and reject characters. */
+static void test_putc_unbuffered(void)
+{
+  int fd = temp_file(NULL, 0);
+  int copy = dup(fd);
+  iofile_t file = iobuf_dopen_sized(fd, 0, 0, 0);
+  char path[64];
+  int i;
+
+  for(i = 0 ; i < 100 ; i++)
+    CHECK(iobuf_putc('a' + i % 26, file) == 'a' + i % 26);
+  CHECK(iobuf_put_dec(file, -7, 20, '0') == 20);
+  CHECK(file_size(copy) == 0);
+  CHECK(iobuf_tell(file) == 120);
+  CHECK(iobuf_close(file) == 0);
+  CHECK(file_size(copy) == 120);
+
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", copy);
+  file = iobuf_open(path, O_RDONLY, 0);
+  CHECK(file != NULL);
+  if(file) {
+    for(i = 0 ; i < 100 ; i++) {
+      errno = 0;
+      CHECK(iobuf_putc('x', file) < 0 && errno == EBADF);
+    }
+    CHECK(iobuf_put_str(file, "x", 40) < 0);
+    CHECK(iobuf_getc(file) == 'a');
+    CHECK(iobuf_close(file) == 0);
+  }
+
+  file = iobuf_dopen_sized(dup(copy), 0, 0, IOBUF_MMAP);
+  errno = 0;
+  CHECK(iobuf_putc('x', file) < 0 && errno == EBADF);
+  /* the widest left-justified field, rejected before any write */
+  CHECK(iobuf_put_dec(file, 1, INT_MIN, ' ') < 0);
+  CHECK(iobuf_close(file) == 0);
+  close(copy);
+}
+
+int main(void)
+{
+  test_async_write();
+  test_mmap_first_read();
+  test_mmap_position();
+  test_seek_window();
+  test_pipe_seek();
+  test_peek_consume();
+  test_getline_refill();
+  test_getdelims();
+  test_grow();
+  test_auto_size();
+  test_gather_write();
+  test_put_fields();
+  test_putc_unbuffered();
+
+  if(failures)
+    errx(1, "%u failures", failures);
+  printf("ok\n");
+
+  return 0;
+}
@@ -26,73 +26,778 @@
 # define _POSIX_C_SOURCE 200112L
 #endif /* _POSIX_C_SOURCE */
 
+#ifdef __linux__
+# define _GNU_SOURCE /* F_GETPIPE_SZ */
+#endif /* __linux__ */
+
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "iobuf.h"
+#include "scan.h"
 
 #ifndef MIN
 # define MIN(a, b) ((a) < (b) ? (a) : (b))
 #endif /* MIN */
 
+#ifndef MAX
+# define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif /* MAX */
+
+#ifndef IOV_MAX
+# define IOV_MAX 1024
+#endif /* IOV_MAX */
+
+/* We use the largest offset type available. */
+#if !defined(__FreeBSD__) && defined(_LARGEFILE64_SOURCE)
+typedef off64_t iooff_t;
+# define sys_lseek lseek64
+#else
+typedef off_t iooff_t;
+# define sys_lseek lseek
+#endif
+
+/* Internal flag for in-memory streams. */
+#define IOBUF_MEMORY 0x100
+
+/* Size of the sliding window in mmap mode. */
+#define MAP_WINDOW (64 * 1024 * 1024)
+
 struct iofile {
   int fd;
+  int flags;
 
-  unsigned int write_size;
-  unsigned int read_size;
+  size_t write_size;
+  size_t read_size;
   char *write_buf;
   char *read_buf;
-  char buf[IOBUF_SIZE * 2];
+
+  size_t write_cap;
+  size_t read_cap;
+  char *write_base;
+  char *read_base;
+
+  /* the write half was allocated by grow_write_buffer() */
+  int write_owned;
+
+  /* The read buffer holds the bytes of the file from read_start up to
+     offset, which is also the offset of the descriptor (not counting a
+     chunk read ahead). It is negative when the file is not seekable. */
+  char *read_start;
+  iooff_t offset;
+
+  /* mmap mode */
+  char  *map;
+  size_t map_size;
+  off_t  map_offset;
+  off_t  file_size;
+
+  /* asynchronous mode */
+  struct async *async;
+
+  char buf[];
 };
 
+static int sync_position(iofile_t file);
+
+enum async_state { ASYNC_IDLE, ASYNC_PENDING, ASYNC_DONE };
+
+/* In asynchronous mode a helper thread reads the next chunk of the file
+   while the current one is consumed and writes the previous buffer while
+   the next one is filled. Each read slot is preceded by an headroom as
+   large as the slot so that unread bytes can be moved just before the new
+   chunk and stay contiguous with it. */
+struct async {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  int quit;
+
+  char *slot[2];
+  int front;
+  enum async_state read_state;
+  ssize_t read_result;
+  int read_errno;
+
+  char *wbuf[2];
+  int wfront;
+  enum async_state write_state;
+  size_t write_len;
+  int write_error;
+};
+
+static void * async_helper(void *arg)
+{
+  struct iofile *file = arg;
+  struct async *async = file->async;
+
+  /* Only the read may be interrupted when the stream is closed. */
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+  pthread_mutex_lock(&async->lock);
+  while(1) {
+    while(!async->quit &&
+          async->read_state  != ASYNC_PENDING &&
+          async->write_state != ASYNC_PENDING)
+      pthread_cond_wait(&async->cond, &async->lock);
+
+    if(async->write_state == ASYNC_PENDING) {
+      char  *buf = async->wbuf[!async->wfront];
+      size_t len = async->write_len;
+      int error  = 0;
+
+      pthread_mutex_unlock(&async->lock);
+      while(len) {
+        ssize_t partial_write = write(file->fd, buf, len);
+        if(partial_write < 0) {
+          error = errno;
+          break;
+        }
+
+        len -= partial_write;
+        buf += partial_write;
+      }
+      pthread_mutex_lock(&async->lock);
+
+      async->write_error = error;
+      async->write_state = ASYNC_IDLE;
+      pthread_cond_broadcast(&async->cond);
+    }
+    else if(async->read_state == ASYNC_PENDING) {
+      ssize_t partial_read;
+
+      pthread_mutex_unlock(&async->lock);
+      pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+      partial_read = read(file->fd, async->slot[!async->front],
+                          file->read_cap);
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+      pthread_mutex_lock(&async->lock);
+
+      async->read_result = partial_read;
+      async->read_errno  = errno;
+      async->read_state  = ASYNC_DONE;
+      pthread_cond_broadcast(&async->cond);
+    }
+    else if(async->quit)
+      break;
+  }
+  pthread_mutex_unlock(&async->lock);
+
+  return NULL;
+}
+
+static int async_start(iofile_t file, char *rbuf, char *wbuf)
+{
+  struct async *async = malloc(sizeof(struct async));
+  if(!async)
+    return -1;
+
+  async->quit        = 0;
+  async->front       = 0;
+  async->wfront      = 0;
+  async->read_state  = ASYNC_IDLE;
+  async->write_state = ASYNC_IDLE;
+  async->write_error = 0;
+  async->slot[0]     = rbuf + file->read_cap;
+  async->slot[1]     = rbuf + file->read_cap * 3;
+  async->wbuf[0]     = file->write_base;
+  async->wbuf[1]     = wbuf;
+
+  pthread_mutex_init(&async->lock, NULL);
+  pthread_cond_init(&async->cond, NULL);
+
+  file->async = async;
+
+  if(pthread_create(&async->thread, NULL, async_helper, file)) {
+    pthread_mutex_destroy(&async->lock);
+    pthread_cond_destroy(&async->cond);
+    free(async);
+    file->async = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Wait until the previous write-behind is done.
+   Return its status and clear it. */
+static int async_wait_write(struct async *async)
+{
+  int error;
+
+  pthread_mutex_lock(&async->lock);
+  while(async->write_state == ASYNC_PENDING)
+    pthread_cond_wait(&async->cond, &async->lock);
+  error = async->write_error;
+  async->write_error = 0;
+  pthread_mutex_unlock(&async->lock);
+
+  if(error) {
+    errno = error;
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Hand the pending bytes over to the helper
+   and continue with the other write buffer. */
+static int async_flush(iofile_t file)
+{
+  struct async *async = file->async;
+
+  if(async_wait_write(async) < 0)
+    return -1;
+
+  if(!file->write_size)
+    return 0;
+
+  if(sync_position(file) < 0)
+    return -1;
+
+  if(file->offset >= 0)
+    file->offset += file->write_size;
+
+  pthread_mutex_lock(&async->lock);
+  async->write_len   = file->write_size;
+  async->write_state = ASYNC_PENDING;
+  async->wfront      = !async->wfront;
+  pthread_cond_broadcast(&async->cond);
+  pthread_mutex_unlock(&async->lock);
+
+  file->write_base = file->write_buf = async->wbuf[async->wfront];
+  file->write_size = 0;
+
+  return 0;
+}
+
+/* Ask the helper to read the next chunk into the back slot. */
+static void async_submit_read(struct async *async)
+{
+  pthread_mutex_lock(&async->lock);
+  async->read_state = ASYNC_PENDING;
+  pthread_cond_broadcast(&async->cond);
+  pthread_mutex_unlock(&async->lock);
+}
+
+/* Wait for the chunk read ahead and append it after the unread bytes.
+   The next chunk is immediately requested. Return the number of bytes
+   appended, zero on EOF. */
+static ssize_t async_refill(iofile_t file)
+{
+  struct async *async = file->async;
+  ssize_t partial_read;
+  char *slot;
+
+  if(async->read_state == ASYNC_IDLE)
+    async_submit_read(async);
+
+  pthread_mutex_lock(&async->lock);
+  while(async->read_state != ASYNC_DONE)
+    pthread_cond_wait(&async->cond, &async->lock);
+  async->read_state = ASYNC_IDLE;
+  partial_read      = async->read_result;
+  pthread_mutex_unlock(&async->lock);
+
+  if(partial_read < 0) {
+    errno = async->read_errno;
+    return partial_read;
+  }
+  else if(partial_read == 0)
+    return 0;
+
+  /* The unread bytes are moved in the headroom of the new slot. */
+  slot = async->slot[!async->front];
+  memcpy(slot - file->read_size, file->read_buf, file->read_size);
+  file->read_start = file->read_buf = slot - file->read_size;
+  file->read_size += partial_read;
+  async->front     = !async->front;
+
+  if(file->offset >= 0)
+    file->offset += partial_read;
+
+  async_submit_read(async);
+
+  return partial_read;
+}
+
+/* Discard the chunk read ahead if any.
+   Return the number of bytes discarded. */
+static ssize_t async_cancel_read(struct async *async)
+{
+  ssize_t discarded = 0;
+
+  pthread_mutex_lock(&async->lock);
+  if(async->read_state != ASYNC_IDLE) {
+    while(async->read_state != ASYNC_DONE)
+      pthread_cond_wait(&async->cond, &async->lock);
+    if(async->read_result > 0)
+      discarded = async->read_result;
+    async->read_state = ASYNC_IDLE;
+  }
+  pthread_mutex_unlock(&async->lock);
+
+  return discarded;
+}
+
+/* Bring the file descriptor back to the end of the buffered data before it
+   is repositioned. The write-behind must be done and the chunk read ahead
+   discarded. */
+static int async_rewind(iofile_t file)
+{
+  ssize_t discarded = async_cancel_read(file->async);
+
+  if(async_wait_write(file->async) < 0)
+    return -1;
+
+  if(discarded && lseek(file->fd, -discarded, SEEK_CUR) < 0)
+    return -1;
+
+  return 0;
+}
+
+/* The descriptor is ahead of the logical position when unread bytes are
+   buffered. Move it back and drop them before writing, so that reads and
+   writes can be mixed on seekable files. */
+static int sync_position(iofile_t file)
+{
+  iooff_t pos;
+
+  if(file->offset < 0 || !file->read_size || (file->flags & IOBUF_MMAP))
+    return 0;
+
+  if(file->async && async_rewind(file) < 0)
+    return -1;
+
+  pos = file->offset - file->read_size;
+  if(sys_lseek(file->fd, pos, SEEK_SET) < 0)
+    return -1;
+
+  file->offset    = pos;
+  file->read_size = 0;
+  file->read_buf  = file->read_start = file->read_base;
+
+  return 0;
+}
+
+/* Stop the helper thread. A read may block indefinitely
+   on a pipe so it is cancelled rather than waited for. */
+static void async_stop(struct async *async)
+{
+  pthread_mutex_lock(&async->lock);
+  if(async->read_state == ASYNC_PENDING)
+    pthread_cancel(async->thread);
+  async->quit = 1;
+  pthread_cond_broadcast(&async->cond);
+  pthread_mutex_unlock(&async->lock);
+
+  pthread_join(async->thread, NULL);
+
+  pthread_mutex_destroy(&async->lock);
+  pthread_cond_destroy(&async->cond);
+  free(async);
+}
+
+/* Logical position of a stream in mmap mode. */
+static iooff_t map_position(iofile_t file)
+{
+  if(!file->map)
+    return file->map_offset;
+
+  return file->map_offset + (file->read_buf - file->map);
+}
+
+/* Slide the mapping so that it starts on the page containing the first
+   unread byte and extends as far as the window size allows. The unread
+   bytes stay contiguous with the new ones. Return the number of bytes
+   that became available, zero on EOF. */
+static ssize_t map_window(iofile_t file)
+{
+  off_t pagemask = ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+  off_t pos      = map_position(file);
+  off_t end      = file->map_offset + file->map_size;
+  off_t start;
+  size_t size;
+  void *map;
+
+  if(end >= file->file_size) {
+    struct stat st;
+
+    /* The file may have grown since we last checked. */
+    if(fstat(file->fd, &st) < 0)
+      return -1;
+    if(end >= st.st_size)
+      return 0;
+
+    file->file_size = st.st_size;
+  }
+
+  start = pos & pagemask;
+  size  = MIN(MAP_WINDOW, file->file_size - start);
+
+  if(file->map)
+    munmap(file->map, file->map_size);
+
+  map = mmap(NULL, size, PROT_READ, MAP_SHARED, file->fd, start);
+  if(map == MAP_FAILED) {
+    file->map       = NULL;
+    file->map_size  = 0;
+    file->read_buf  = NULL;
+    file->read_size = 0;
+    file->map_offset = pos;
+    return -1;
+  }
+  posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  /* Kernels with huge pages in the page cache may then back the window
+     with them, others ignore the advice. */
+  (void)madvise(map, size, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+
+  file->map        = map;
+  file->map_size   = size;
+  file->map_offset = start;
+  file->read_start = map;
+  file->read_buf   = file->map + (pos - start);
+  file->read_size  = size - (pos - start);
+
+  return start + size - MAX(end, pos);
+}
+
+/* Reposition a stream in mmap mode. We just remember the new position
+   when it lies outside of the current mapping and the next read maps
+   the window from there. */
+static void map_seek(iofile_t file, off_t pos)
+{
+  off_t end = file->map_offset + file->map_size;
+
+  if(pos >= file->map_offset && pos <= end && file->map) {
+    file->read_buf  = file->map + (pos - file->map_offset);
+    file->read_size = end - pos;
+    return;
+  }
+
+  if(file->map)
+    munmap(file->map, file->map_size);
+
+  file->map        = NULL;
+  file->map_size   = 0;
+  file->map_offset = pos;
+  file->read_buf   = NULL;
+  file->read_size  = 0;
+}
+
 static ssize_t fill_buffer(iofile_t file)
 {
-  ssize_t partial_read = IOBUF_SIZE * 2; /* no refill */
+  ssize_t partial_read = file->read_cap; /* no refill */
 
   if(file->read_size == 0) {
-    partial_read = read(file->fd, file->buf + IOBUF_SIZE, IOBUF_SIZE);
+    if(file->flags & IOBUF_MMAP)
+      return map_window(file);
+    else if(file->async)
+      return async_refill(file);
+
+    partial_read = read(file->fd, file->read_base, file->read_cap);
     if(partial_read < 0) /* read error */
       return partial_read;
 
     file->read_size = partial_read;
-    file->read_buf  = file->buf + IOBUF_SIZE;
+    file->read_buf  = file->read_start = file->read_base;
+    if(file->offset >= 0)
+      file->offset += partial_read;
   }
 
   return partial_read;
 }
 
+/* Move the unread bytes at the beginning of the read half and
+   append as much as possible after them. This is only needed when
+   a record straddles the end of the buffered data. Return the number
+   of bytes appended, zero on EOF or when the read half is full. */
+static ssize_t refill_buffer(iofile_t file)
+{
+  char *base = file->read_base;
+  ssize_t partial_read;
+
+  if(file->read_size >= file->read_cap)
+    return 0;
+
+  if(file->flags & IOBUF_MMAP)
+    return map_window(file);
+  else if(file->async)
+    return async_refill(file);
+
+  if(file->read_buf != base) {
+    memmove(base, file->read_buf, file->read_size);
+    file->read_buf = file->read_start = base;
+  }
+
+  partial_read = read(file->fd, base + file->read_size,
+                      file->read_cap - file->read_size);
+  if(partial_read > 0) {
+    file->read_size += partial_read;
+    if(file->offset >= 0)
+      file->offset += partial_read;
+  }
+
+  return partial_read;
+}
+
+/* Grow the write half so that count more bytes fit after the pending ones.
+   The first time it leaves the iofile structure for its own allocation. */
+static int grow_write_buffer(iofile_t file, size_t count)
+{
+  size_t cap = file->write_cap;
+  char *base;
+
+  while(cap - file->write_size < count)
+    cap *= 2;
+
+  if(!file->write_owned) {
+    base = malloc(cap);
+    if(base)
+      memcpy(base, file->write_base, file->write_size);
+  }
+  else
+    base = realloc(file->write_base, cap);
+
+  if(!base)
+    return -1;
+
+  file->write_base  = base;
+  file->write_buf   = base + file->write_size;
+  file->write_cap   = cap;
+  file->write_owned = 1;
+
+  return 0;
+}
+
+/* Write the pending bytes of the write half followed by the
+   specified vector using as few syscalls as possible. The
+   caller must ensure that iovcnt is less than IOV_MAX. */
+static int gather_write(iofile_t file, const struct iovec *iov, int iovcnt)
+{
+  struct iovec vec[iovcnt + 1];
+  struct iovec *v = vec;
+  size_t count = file->write_size;
+  int n = iovcnt + 1;
+  int i;
+
+  for(i = 0 ; i < iovcnt ; i++)
+    count += iov[i].iov_len;
+
+  /* keep the order with the write-behind */
+  if(file->async && async_wait_write(file->async) < 0)
+    return -1;
+
+  if(sync_position(file) < 0)
+    return -1;
+
+  vec[0].iov_base = file->write_base;
+  vec[0].iov_len  = file->write_size;
+  memcpy(vec + 1, iov, iovcnt * sizeof(struct iovec));
+
+  while(n) {
+    ssize_t partial_write = writev(file->fd, v, n);
+    if(partial_write < 0)
+      return partial_write;
+
+    /* skip what has been written, the kernel may stop anywhere */
+    while(n && (size_t)partial_write >= v->iov_len) {
+      partial_write -= v->iov_len;
+      v++;
+      n--;
+    }
+
+    if(n) {
+      v->iov_base  = (char *)v->iov_base + partial_write;
+      v->iov_len  -= partial_write;
+    }
+  }
+
+  if(file->offset >= 0)
+    file->offset += count;
+
+  file->write_size = 0;
+  file->write_buf  = file->write_base;
+
+  return 0;
+}
+
+/* Guess an efficient buffer size for this file descriptor. */
+static size_t auto_size(int fd)
+{
+  struct stat st;
+  size_t size = IOBUF_SIZE;
+
+  if(fstat(fd, &st) < 0)
+    return size;
+
+#ifdef F_GETPIPE_SZ
+  if(S_ISFIFO(st.st_mode)) {
+    int pipe_size = fcntl(fd, F_GETPIPE_SZ);
+    if(pipe_size > 0)
+      return MAX(size, (size_t)pipe_size);
+  }
+#endif /* F_GETPIPE_SZ */
+
+  return MAX(size, (size_t)st.st_blksize);
+}
+
+/* Make room for count more bytes in the write buffer by flushing or
+   growing it. Return zero when the bytes do not fit in the buffer and
+   should rather be written along with the pending ones, one when they
+   fit and a negative value on error. */
+static int make_room(iofile_t file, size_t count)
+{
+  /* the mapping is read-only */
+  if(file->flags & IOBUF_MMAP) {
+    errno = EBADF;
+    return -1;
+  }
+
+  if(count <= file->write_cap - file->write_size)
+    return 1;
+
+  if(file->flags & IOBUF_MEMORY) {
+    if(grow_write_buffer(file, count) < 0)
+      return -1;
+    return 1;
+  }
+
+  if(count > file->write_cap && !(file->flags & IOBUF_GROW))
+    return 0;
+
+  if(iobuf_flush(file) < 0)
+    return -1;
+
+  if(count > file->write_cap && grow_write_buffer(file, count) < 0)
+    return -1;
+
+  return 1;
+}
+
 int iobuf_flush(iofile_t file)
 {
-  int write_size  = file->write_size;
+  size_t write_size = file->write_size;
+  char  *write_buf  = file->write_base;
+
+  if(file->async)
+    return async_flush(file);
+
+  /* nowhere to write in-memory streams */
+  if(file->flags & IOBUF_MEMORY)
+    return 0;
+
+  if(write_size && sync_position(file) < 0)
+    return -1;
 
   while(write_size) {
-    ssize_t partial_write = write(file->fd, file->buf, write_size);
+    ssize_t partial_write = write(file->fd, write_buf, write_size);
     if(partial_write < 0)
       return partial_write;
 
     write_size -= partial_write;
+    write_buf  += partial_write;
   }
 
+  if(file->offset >= 0)
+    file->offset += file->write_size;
+
   file->write_size = 0;
-  file->write_buf  = file->buf;
+  file->write_buf  = file->write_base;
 
   return 0;
 }
 
-iofile_t iobuf_dopen(int fd)
+iofile_t iobuf_dopen_sized(int fd, size_t read_size, size_t write_size,
+                           int flags)
 {
-  struct iofile *file = malloc(sizeof(struct iofile));
+  struct iofile *file;
+  struct stat st;
+  size_t size = 0;
+
+  /* The mmap mode only applies to regular files,
+     other files fallback on the buffered mode. */
+  if(flags & IOBUF_MMAP) {
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+      flags &= ~IOBUF_MMAP;
+    else
+      read_size = MAP_WINDOW - sysconf(_SC_PAGESIZE);
+  }
+
+  /* The write buffers are exchanged with the helper. */
+  if(flags & IOBUF_MMAP)
+    flags &= ~IOBUF_ASYNC;
+  if(flags & IOBUF_ASYNC)
+    flags &= ~IOBUF_GROW;
+
+  if(read_size == IOBUF_AUTO || write_size == IOBUF_AUTO)
+    size = auto_size(fd);
+  if(read_size == IOBUF_AUTO)
+    read_size = size;
+  if(write_size == IOBUF_AUTO)
+    write_size = size;
+
+  /* Streams in mmap mode are read-only. Neither are write buffers,
+     nor the write-behind slots in asynchronous mode, allocated for
+     descriptors which are not open for writing. */
+  if(flags & IOBUF_MMAP || (fcntl(fd, F_GETFL) & O_ACCMODE) == O_RDONLY)
+    write_size = 0;
+
+  if(flags & IOBUF_MMAP)
+    file = malloc(sizeof(struct iofile));
+  else if(flags & IOBUF_ASYNC)
+    file = malloc(sizeof(struct iofile) + write_size * 2 + read_size * 4);
+  else
+    file = malloc(sizeof(struct iofile) + write_size + read_size);
   if(!file)
     return NULL;
 
-  file->fd         = fd;
-  file->write_buf  = file->buf;
-  file->read_buf   = file->buf + IOBUF_SIZE;
-  file->write_size = file->read_size = 0;
+  file->fd          = fd;
+  file->flags       = flags;
+  file->write_cap   = write_size;
+  file->read_cap    = read_size;
+  file->write_base  = file->write_buf = file->buf;
+  file->read_base   = file->read_buf  = file->buf + write_size;
+  file->read_start  = file->read_base;
+  file->write_size  = file->read_size = 0;
+  file->write_owned = 0;
+  file->offset      = sys_lseek(fd, 0, SEEK_CUR);
+  file->map         = NULL;
+  file->map_size    = 0;
+  file->async       = NULL;
+
+  /* In asynchronous mode the second write buffer follows the first one
+     and the read buffer starts empty in the first read slot. */
+  if(flags & IOBUF_ASYNC) {
+    file->read_base = file->read_buf = file->read_start =
+      file->buf + write_size * 2 + read_size;
+
+    if(async_start(file, file->buf + write_size * 2,
+                   file->buf + write_size) < 0) {
+      free(file);
+      return NULL;
+    }
+  }
+
+  if(flags & IOBUF_MMAP) {
+    file->read_base  = file->read_buf = file->read_start = NULL;
+    file->map_offset = file->offset < 0 ? 0 : file->offset;
+    file->file_size  = st.st_size;
+
+    return file;
+  }
 
 /* We only declare the access pattern on architectures
    that are known to support posix_fadvise. */
@@ -103,6 +808,11 @@ iofile_t iobuf_dopen(int fd)
   return file;
 }
 
+iofile_t iobuf_dopen(int fd)
+{
+  return iobuf_dopen_sized(fd, IOBUF_SIZE, IOBUF_SIZE, 0);
+}
+
 iofile_t iobuf_open(const char *pathname, int flags, mode_t mode)
 {
   int fd = open(pathname, flags, mode);
@@ -115,29 +825,133 @@ iofile_t iobuf_open(const char *pathname, int flags, mode_t mode)
 
 ssize_t iobuf_write(iofile_t file, const void *buf, size_t count)
 {
-  if(count > (IOBUF_SIZE - file->write_size)) {
-    ssize_t partial_write;
+  int room = make_room(file, count);
+
+  if(room < 0)
+    return room;
+  else if(!room) {
+    /* Large records are submitted along with the
+       pending bytes in a single syscall. */
+    struct iovec iov = { .iov_base = (void *)buf, .iov_len = count };
+
+    if(gather_write(file, &iov, 1) < 0)
+      return -1;
+    return count;
+  }
 
-    partial_write = iobuf_flush(file);
-    if(partial_write < 0)
-      return partial_write;
+  memcpy(file->write_buf, buf, count);
+  file->write_size += count;
+  file->write_buf  += count;
+
+  return count;
+}
 
-    if(count > IOBUF_SIZE) {
-      ssize_t full_write;
-      full_write = write(file->fd, buf, count);
-      if(full_write < 0)
-        return full_write;
-      return partial_write + full_write;
+ssize_t iobuf_writev(iofile_t file, const struct iovec *iov, int iovcnt)
+{
+  size_t count = 0;
+  int room;
+  int i;
+
+  for(i = 0 ; i < iovcnt ; i++)
+    count += iov[i].iov_len;
+
+  room = make_room(file, count);
+  if(room < 0)
+    return room;
+  else if(!room) {
+    if(iovcnt < IOV_MAX) {
+      if(gather_write(file, iov, iovcnt) < 0)
+        return -1;
+      return count;
+    }
+
+    /* too many vectors, fallback on separate writes */
+    for(i = 0 ; i < iovcnt ; i++) {
+      ssize_t partial_write = iobuf_write(file, iov[i].iov_base,
+                                          iov[i].iov_len);
+      if(partial_write < 0)
+        return partial_write;
     }
+    return count;
   }
 
-  memcpy(file->write_buf, buf, count);
+  for(i = 0 ; i < iovcnt ; i++) {
+    memcpy(file->write_buf, iov[i].iov_base, iov[i].iov_len);
+    file->write_buf += iov[i].iov_len;
+  }
   file->write_size += count;
-  file->write_buf  += count;
 
   return count;
 }
 
+int iobuf_vprintf(iofile_t file, const char *format, va_list ap)
+{
+  size_t room = file->write_cap - file->write_size;
+  va_list aq;
+  int n;
+
+  /* First try to format directly into the write buffer. */
+  va_copy(aq, ap);
+  n = vsnprintf(file->write_buf, room, format, aq);
+  va_end(aq);
+  if(n < 0)
+    return n;
+
+  if((size_t)n >= room) {
+    int fit = make_room(file, n + 1);
+    if(fit < 0)
+      return fit;
+    else if(!fit) {
+      /* too large for the buffer */
+      char *buf = malloc(n + 1);
+      if(!buf)
+        return -1;
+
+      vsnprintf(buf, n + 1, format, ap);
+      n = iobuf_write(file, buf, n);
+      free(buf);
+
+      return n;
+    }
+
+    vsnprintf(file->write_buf, n + 1, format, ap);
+  }
+
+  file->write_size += n;
+  file->write_buf  += n;
+
+  return n;
+}
+
+int iobuf_fprintf(iofile_t file, const char *format, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start(ap, format);
+  n = iobuf_vprintf(file, format, ap);
+  va_end(ap);
+
+  return n;
+}
+
+iofile_t iobuf_memopen(size_t size)
+{
+  return iobuf_dopen_sized(-1, 1, size, IOBUF_MEMORY);
+}
+
+ssize_t iobuf_drain(iofile_t file, iofile_t target)
+{
+  ssize_t n = iobuf_write(target, file->write_base, file->write_size);
+  if(n < 0)
+    return n;
+
+  file->write_size = 0;
+  file->write_buf  = file->write_base;
+
+  return n;
+}
+
 ssize_t iobuf_read(iofile_t file, void *buf, size_t count)
 {
   char *cbuf = buf;
@@ -163,6 +977,7 @@ EXIT:
 
 int iobuf_close(iofile_t file)
 {
+  int seek_error = 0;
   int ret;
 
   if(file->write_size) {
@@ -172,22 +987,55 @@ int iobuf_close(iofile_t file)
       return ret;
   }
 
-  ret = close(file->fd);
-  if(ret < 0)
+  if(file->async) {
+    ret = async_wait_write(file->async);
+    async_stop(file->async);
+    file->async = NULL;
+
+    if(ret < 0)
+      return ret;
+  }
+
+  /* Reads do not move the descriptor in mmap mode. Leave it at the
+     logical position for those who share it. A failure is reported
+     once the stream is released. */
+  if((file->flags & IOBUF_MMAP) &&
+     sys_lseek(file->fd, map_position(file), SEEK_SET) < 0)
+    seek_error = errno;
+
+  if(file->map)
+    munmap(file->map, file->map_size);
+
+  ret = file->fd < 0 ? 0 : close(file->fd);
+  if(ret < 0 && !seek_error)
     return ret;
 
+  if(file->write_owned)
+    free(file->write_base);
   free(file);
 
+  if(seek_error) {
+    errno = seek_error;
+    return -1;
+  }
+
   return ret;
 }
 
 int iobuf_putc(char c, iofile_t file)
 {
-  if(file->write_size == IOBUF_SIZE) {
-    ssize_t partial_write;
-    partial_write = iobuf_flush(file);
-    if(partial_write < 0)
-      return partial_write;
+  if(file->write_size == file->write_cap) {
+    int room = make_room(file, 1);
+    if(room < 0)
+      return room;
+    else if(!room) {
+      /* no write buffer */
+      struct iovec iov = { .iov_base = &c, .iov_len = 1 };
+
+      if(gather_write(file, &iov, 1) < 0)
+        return -1;
+      return c;
+    }
   }
 
   *file->write_buf = c;
@@ -197,6 +1045,153 @@ int iobuf_putc(char c, iofile_t file)
   return c;
 }
 
+/* Two digits decimal conversion table. */
+static const char digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+/* Convert value in decimal backward from the end of buf.
+   Return the first digit. */
+static char * format_udec(char *end, uintmax_t value)
+{
+  char *p = end;
+
+  while(value >= 100) {
+    unsigned int i = (value % 100) * 2;
+    value /= 100;
+    *--p = digit_pairs[i + 1];
+    *--p = digit_pairs[i];
+  }
+
+  if(value >= 10) {
+    *--p = digit_pairs[value * 2 + 1];
+    *--p = digit_pairs[value * 2];
+  }
+  else
+    *--p = '0' + value;
+
+  return p;
+}
+
+/* Write the field s (len bytes) preceded by the optional sign character
+   and padded up to width as printf() does. A negative width left-justify
+   the field, otherwise it is padded on the left with spaces or zeros
+   according to pad. */
+static ssize_t put_field(iofile_t file, char sign, const char *s, size_t len,
+                         int width, char pad)
+{
+  size_t size    = len + (sign ? 1 : 0);
+  size_t padding = 0;
+  int left       = width < 0;
+  unsigned int field;
+  int room;
+  char *p;
+
+  /* negate as unsigned to handle INT_MIN */
+  field = left ? -(unsigned int)width : (unsigned int)width;
+  if(field > size)
+    padding = field - size;
+
+  room = make_room(file, size + padding);
+  if(room < 0)
+    return room;
+  else if(!room) {
+    /* field larger than the buffer */
+    size_t i;
+
+    for(i = 0 ; !left && pad != '0' && i < padding ; i++)
+      if(iobuf_putc(' ', file) < 0)
+        return -1;
+    if(sign && iobuf_putc(sign, file) < 0)
+      return -1;
+    for(i = 0 ; !left && pad == '0' && i < padding ; i++)
+      if(iobuf_putc('0', file) < 0)
+        return -1;
+    if(iobuf_write(file, s, len) < 0)
+      return -1;
+    for(i = 0 ; left && i < padding ; i++)
+      if(iobuf_putc(' ', file) < 0)
+        return -1;
+    return size + padding;
+  }
+
+  p = file->write_buf;
+
+  if(!left && pad != '0') {
+    memset(p, ' ', padding);
+    p += padding;
+  }
+  if(sign)
+    *p++ = sign;
+  if(!left && pad == '0') {
+    memset(p, '0', padding);
+    p += padding;
+  }
+  memcpy(p, s, len);
+  p += len;
+  if(left) {
+    memset(p, ' ', padding);
+    p += padding;
+  }
+
+  file->write_buf   = p;
+  file->write_size += size + padding;
+
+  return size + padding;
+}
+
+ssize_t iobuf_put_udec(iofile_t file, uintmax_t value, int width, char pad)
+{
+  char buf[3 * sizeof(uintmax_t)];
+  char *end = buf + sizeof(buf);
+  char *p   = format_udec(end, value);
+
+  return put_field(file, 0, p, end - p, width, pad);
+}
+
+ssize_t iobuf_put_dec(iofile_t file, intmax_t value, int width, char pad)
+{
+  char buf[3 * sizeof(uintmax_t)];
+  char *end = buf + sizeof(buf);
+  char *p;
+
+  /* negate as unsigned to handle INTMAX_MIN */
+  if(value < 0) {
+    p = format_udec(end, -(uintmax_t)value);
+    return put_field(file, '-', p, end - p, width, pad);
+  }
+
+  p = format_udec(end, value);
+  return put_field(file, 0, p, end - p, width, pad);
+}
+
+ssize_t iobuf_put_oct(iofile_t file, uintmax_t value, int width, char pad)
+{
+  char buf[3 * sizeof(uintmax_t)];
+  char *end = buf + sizeof(buf);
+  char *p   = end;
+
+  do {
+    *--p = '0' + (value & 7);
+    value >>= 3;
+  } while(value);
+
+  return put_field(file, 0, p, end - p, width, pad);
+}
+
+ssize_t iobuf_put_str(iofile_t file, const char *s, int width)
+{
+  return put_field(file, 0, s, strlen(s), width, ' ');
+}
+
 int iobuf_getc(iofile_t file)
 {
   ssize_t partial_read = fill_buffer(file);
@@ -205,9 +1200,8 @@ int iobuf_getc(iofile_t file)
   else if(!partial_read)
     return GETC_EOF;
 
-  file->read_buf++;
   file->read_size--;
-  return *file->read_buf;
+  return (unsigned char)*file->read_buf++;
 }
 
 ssize_t iobuf_gets(iofile_t file, void *buf, size_t count)
@@ -217,7 +1211,7 @@ ssize_t iobuf_gets(iofile_t file, void *buf, size_t count)
   count--;
 
   do {
-    char *eol;
+    const char *eol;
     ssize_t partial_read = fill_buffer(file);
     if(partial_read == 0)
       goto EXIT;
@@ -226,7 +1220,8 @@ ssize_t iobuf_gets(iofile_t file, void *buf, size_t count)
 
     partial_read = MIN(count, file->read_size);
 
-    eol = memchr(file->read_buf, '\n', partial_read);
+    eol = partial_read ? scan_byte(file->read_buf, partial_read, '\n')
+                       : NULL;
     if(eol) {
       partial_read  = eol - file->read_buf + 1; /* keep newline */
       count         = partial_read; /* will be zero and break */
@@ -247,86 +1242,201 @@ EXIT:
   return cbuf - (char *)buf;
 }
 
-off_t iobuf_lseek(iofile_t file, off_t offset, int whence)
+ssize_t iobuf_peek(iofile_t file, const char **window, size_t count)
 {
-  if(whence == SEEK_CUR) {
-    /* There may be an overflow here. We merely assume that the user won't use
-       an offset large enough to overflow. */
-    off_t partial = offset - file->read_size;
-
-     /* If we seek inside the buffer (short relative seek) then we may avoid
-        having to drain the buffers. This may improve the performances as most
-        relative seeks are very short and absolute seeks are generally
-        unrecoverable. */
-    if(partial > 0)
-      offset = partial;
-    else if(partial + IOBUF_SIZE < 0)
-      offset = - (offset + file->read_size);
-    else {
-      file->read_buf  += offset;
-      file->read_size -= offset;
-
-      /* We do not know about the absolute offset location in the file. As it
-         would inflict a slight overhead to other funtions just for the benefit
-         of returning the absolute location that most peoples will ignore in
-         this specific case, we just ignore and return zero to let the user know
-         that one syscall has been spared. */
-      return 0;
-    }
+  count = MIN(MAX(count, 1), file->read_cap);
+
+  while(file->read_size < count) {
+    ssize_t partial_read = refill_buffer(file);
+    if(partial_read < 0)
+      return partial_read;
+    else if(partial_read == 0)
+      break;
   }
 
-  off_t res = lseek(file->fd, offset, whence);
-  if(res < 0)
-    return res;
+  *window = file->read_buf;
 
-  file->read_size = 0;
-  file->read_buf  = file->buf + 2 * IOBUF_SIZE;
+  return file->read_size;
+}
 
-  if(file->write_size)
-    iobuf_flush(file);
+void iobuf_consume(iofile_t file, size_t count)
+{
+  count = MIN(count, file->read_size);
 
-  return res;
+  file->read_buf  += count;
+  file->read_size -= count;
 }
 
-#if !defined(__FreeBSD__) && defined(_LARGEFILE64_SOURCE)
-off64_t iobuf_lseek64(iofile_t file, off64_t offset, int whence)
+ssize_t iobuf_getline(iofile_t file, const char **line)
 {
-  if(whence == SEEK_CUR) {
-    /* There may be an overflow here. We merely assume that the user won't use
-       an offset large enough to overflow. */
-    off64_t partial = offset - file->read_size;
-
-     /* If we seek inside the buffer (short relative seek) then we may avoid
-        having to drain the buffers. This may improve the performances as most
-        relative seeks are very short and absolute seeks are generally
-        unrecoverable. */
-    if(partial > 0)
-      offset = partial;
-    else if(partial + IOBUF_SIZE < 0)
-      offset = - (offset + file->read_size);
-    else {
-      file->read_buf  += offset;
-      file->read_size -= offset;
-
-      /* We do not know about the absolute offset location in the file. As it
-         would inflict a slight overhead to other funtions just for the benefit
-         of returning the absolute location that most peoples will ignore in
-         this specific case, we just ignore and return zero to let the user know
-         that one syscall has been spared. */
-      return 0;
+  return iobuf_getdelim(file, line, '\n');
+}
+
+ssize_t iobuf_getdelim(iofile_t file, const char **record, int delim)
+{
+  char set = delim;
+
+  return iobuf_getdelims(file, record, &set, 1);
+}
+
+ssize_t iobuf_getdelims(iofile_t file, const char **record,
+                        const char *set, size_t nset)
+{
+  size_t scanned = 0;
+  size_t length;
+
+  while(1) {
+    ssize_t partial_read;
+    const char *eor = NULL;
+
+    /* nothing is mapped yet in mmap mode */
+    if(file->read_size > scanned) {
+      const char *s = file->read_buf + scanned;
+      size_t n      = file->read_size - scanned;
+
+      eor = nset == 1 ? scan_byte(s, n, *set) : scan_set(s, n, set, nset);
+    }
+    if(eor) {
+      length = eor - file->read_buf + 1; /* keep delimiter */
+      break;
+    }
+
+    /* We only compact the read half when the record
+       straddles the end of the buffered data. */
+    scanned = file->read_size;
+    partial_read = refill_buffer(file);
+    if(partial_read < 0)
+      return partial_read;
+    else if(partial_read == 0) {
+      /* EOF or record longer than the read half */
+      length = file->read_size;
+      break;
     }
   }
 
-  off64_t res = lseek64(file->fd, offset, whence);
+  *record = file->read_buf;
+  file->read_buf  += length;
+  file->read_size -= length;
+
+  return length;
+}
+
+/* Reposition the stream, see iobuf_lseek(). */
+static iooff_t seek(iofile_t file, iooff_t offset, int whence)
+{
+  iooff_t res;
+
+  if(file->flags & IOBUF_MMAP) {
+    iooff_t pos = map_position(file);
+    struct stat st;
+
+    switch(whence) {
+    case SEEK_CUR:
+      offset += pos;
+      break;
+    case SEEK_END:
+      if(fstat(file->fd, &st) < 0)
+        return -1;
+      offset += st.st_size;
+      break;
+    }
+
+    if(offset < 0) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    map_seek(file, offset);
+    return offset;
+  }
+
+  /* The absolute offset of a pipe is unknown but a relative seek inside
+     the buffer is still served. Zero is returned as nothing better can be. */
+  if(file->offset < 0 && !file->write_size && whence == SEEK_CUR &&
+     offset >= file->read_start - file->read_buf &&
+     offset <= (iooff_t)file->read_size) {
+    file->read_buf  += offset;
+    file->read_size -= offset;
+    return 0;
+  }
+
+  /* Seeks inside the buffered window are served without any syscall and
+     the buffer is kept. Even the chunk being read ahead stays valid. */
+  if(file->offset >= 0 && !file->write_size && whence != SEEK_END) {
+    iooff_t start = file->offset - (file->read_buf + file->read_size -
+                                    file->read_start);
+
+    if(whence == SEEK_CUR) {
+      offset += file->offset - file->read_size;
+      whence  = SEEK_SET;
+    }
+
+    if(offset >= start && offset <= file->offset) {
+      file->read_buf  = file->read_start + (offset - start);
+      file->read_size = file->offset - offset;
+      return offset;
+    }
+  }
+
+  if(file->write_size && iobuf_flush(file) < 0)
+    return -1;
+
+  if(file->async && async_rewind(file) < 0)
+    return -1;
+
+  /* The descriptor is ahead of the logical position by the unread bytes. */
+  if(whence == SEEK_CUR)
+    offset -= file->read_size;
+
+  res = sys_lseek(file->fd, offset, whence);
   if(res < 0)
     return res;
 
+  file->offset    = res;
   file->read_size = 0;
-  file->read_buf  = file->buf + 2 * IOBUF_SIZE;
+  file->read_buf  = file->read_start = file->read_base;
 
-  if(file->write_size)
-    iobuf_flush(file);
+  return res;
+}
+
+off_t iobuf_lseek(iofile_t file, off_t offset, int whence)
+{
+  iooff_t res = seek(file, offset, whence);
+
+  if(res != (off_t)res) {
+    errno = EOVERFLOW;
+    return -1;
+  }
 
   return res;
 }
+
+#if !defined(__FreeBSD__) && defined(_LARGEFILE64_SOURCE)
+off64_t iobuf_lseek64(iofile_t file, off64_t offset, int whence)
+{
+  return seek(file, offset, whence);
+}
 #endif
+
+off_t iobuf_tell(iofile_t file)
+{
+  iooff_t pos;
+
+  if(file->flags & IOBUF_MMAP)
+    pos = map_position(file);
+  else if(file->offset < 0) {
+    errno = ESPIPE;
+    return -1;
+  }
+  else
+    pos = file->offset - file->read_size;
+
+  pos += file->write_size;
+
+  if(pos != (off_t)pos) {
+    errno = EOVERFLOW;
+    return -1;
+  }
+
+  return pos;
+}
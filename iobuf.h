@@ -26,11 +26,15 @@
 #define _IOBUF_H_
 
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
+#include <stdarg.h>
 
 #define IOBUF_SIZE 65536
+#define IOBUF_AUTO 0 /* size the buffers from the file descriptor */
 #define GETC_EOF   UCHAR_MAX + 1
 
 /* Remove the single trailing \n
@@ -40,21 +44,45 @@
       buf[size-1] = '\0';                  \
   } while(0)
 
-/* TODO: Define OFF_T_MIN and OFF_T_MAX. */
-
-#define MIN_LSEEK_OFFSET OFF_T_MIN + IOBUF_SIZE
-#define MAX_LSEEK_OFFSET OFF_T_MAX - IOBUF_SIZE
-
-#ifndef __FreeBSD__
-# define MIN_LSEEK64_OFFSET OFF64_T_MIN + IOBUF_SIZE
-# define MAX_LSEEK64_OFFSET OFF64_T_MAX - IOBUF_SIZE
-#endif /* __FreeBSD__ */
+/* Flags for iobuf_dopen_sized(). */
+enum iobuf_flags {
+  IOBUF_GROW  = 0x1, /* grow the write buffer for large records */
+  IOBUF_MMAP  = 0x2, /* map regular files instead of reading them */
+  IOBUF_ASYNC = 0x4  /* read-ahead and write-behind in a helper thread */
+};
 
 typedef struct iofile * iofile_t;
 
 /* This creates an opened stream from an already opened file descriptor. */
 iofile_t iobuf_dopen(int fd);
 
+/* This creates an opened stream from an already opened file descriptor
+   with a read buffer of read_size bytes and a write buffer of write_size
+   bytes. When a size is IOBUF_AUTO it is deduced from the file descriptor,
+   that is the pipe capacity for pipes and the preferred block size for
+   other files, but never less than IOBUF_SIZE. Descriptors open read-only
+   get no write buffer. With the IOBUF_GROW flag
+   records larger than the write buffer make it grow instead of being
+   written without buffering. With the IOBUF_MMAP flag regular files are
+   read through a sliding memory mapping and read_size is ignored. The
+   read functions then serve data directly from the mapping and writes
+   fail with EBADF. The descriptor is moved to the logical position on
+   close since reads do not advance it. Other files
+   such as pipes and sockets fallback on the buffered mode. With the
+   IOBUF_ASYNC flag a helper thread reads the next chunk while the current
+   one is consumed and writes the buffer flushed previously while the next
+   one is filled. Write errors are then reported by the next flush or
+   close. This doubles the buffers and cannot be combined with IOBUF_GROW.
+   When both IOBUF_MMAP and IOBUF_ASYNC are specified the former is used
+   for regular files and the latter for other files. */
+iofile_t iobuf_dopen_sized(int fd, size_t read_size, size_t write_size,
+                           int flags);
+
+/* This creates an in-memory stream. The write buffer is initially size
+   bytes long and grows as needed instead of being flushed. Its content
+   can be moved to another stream with iobuf_drain(). */
+iofile_t iobuf_memopen(size_t size);
+
 /* This opens the file whose name is the string pointed to by pathname
    and associates a stream with it. The arguments flags and mode are
    subject to the same semantic that the ones used in open. */
@@ -65,6 +93,27 @@ iofile_t iobuf_open(const char *pathname, int flags, mode_t mode);
    order to avoid useless syscall switch to kernel mode. */
 ssize_t iobuf_write(iofile_t file, const void *buf, size_t count);
 
+/* Write the iovcnt buffers described by iov to the stream referred to by
+   file, as if they were concatenated, in the same way as iobuf_write().
+   When the whole record does not fit in the user-space buffer, the
+   pending bytes and the record are submitted with a single writev() call.
+   This is useful to avoid multiple calls for records made of small
+   fields. */
+ssize_t iobuf_writev(iofile_t file, const struct iovec *iov, int iovcnt);
+
+/* Format and write to the stream referred to by file as vprintf() does.
+   The output is formatted directly into the write buffer when it fits. */
+int iobuf_vprintf(iofile_t file, const char *format, va_list ap);
+
+/* Same as iobuf_vprintf() with a variable number of arguments. */
+int iobuf_fprintf(iofile_t file, const char *format, ...);
+
+/* Move the bytes pending in the write buffer of file to the stream target
+   instead of writing them to the file descriptor of file. This is mainly
+   used to publish the content of an in-memory stream. Return the number
+   of bytes moved. */
+ssize_t iobuf_drain(iofile_t file, iofile_t target);
+
 /* Attemps to read up to count bytes from the stream referred to by
    file. This is done through an user-space buffer in order to avoid
    useless syscall switch to kernel mode. */
@@ -84,6 +133,19 @@ int iobuf_close(iofile_t file);
 /* Write a single character to the specified file. */
 int iobuf_putc(char c, iofile_t file);
 
+/* Write an unsigned decimal, signed decimal or octal integer padded up to
+   width characters as the printf() %*ju, %*jd and %*jo conversions do.
+   A negative width left-justifies the field. Otherwise pad selects the
+   padding character, either ' ' or '0'. Return the number of bytes
+   written. */
+ssize_t iobuf_put_udec(iofile_t file, uintmax_t value, int width, char pad);
+ssize_t iobuf_put_dec(iofile_t file, intmax_t value, int width, char pad);
+ssize_t iobuf_put_oct(iofile_t file, uintmax_t value, int width, char pad);
+
+/* Write a string padded with spaces up to width characters as the
+   printf() %*s conversion does. */
+ssize_t iobuf_put_str(iofile_t file, const char *s, int width);
+
 /* Read a single character from the specified file.
    Return a negative number in case of error or GETC_EOF
    if the end of file has been reached. */
@@ -99,28 +161,61 @@ int iobuf_getc(iofile_t file);
    the buffer (not including terminal '\0'). */
 ssize_t iobuf_gets(iofile_t file, void *buf, size_t count);
 
+/* Borrow a view into the read buffer of the stream without copying.
+   This ensures that at least count bytes are available contiguously
+   unless the end of file is reached, refilling and compacting the read
+   buffer when needed. The address of the first unread byte is stored in
+   window and the function returns the number of bytes available there,
+   which may be more than requested. The count is capped to the size of
+   the read buffer. A return value of zero indicates EOF and negative
+   values an error. The window stays valid until the next operation on
+   the stream. Bytes are not consumed, see iobuf_consume(). */
+ssize_t iobuf_peek(iofile_t file, const char **window, size_t count);
+
+/* Consume count bytes from the read buffer, generally after they have
+   been processed through a window obtained with iobuf_peek(). It is not
+   possible to consume more bytes than the number currently available. */
+void iobuf_consume(iofile_t file, size_t count);
+
+/* Read the next line of the stream without copying it. The address of
+   the line inside the read buffer is stored in line and the length of
+   the line, including the trailing newline if any, is returned. Lines
+   longer than the read buffer are split. A return value of zero indicates EOF
+   and negative values an error. The line is consumed and stays valid
+   until the next operation on the stream. */
+ssize_t iobuf_getline(iofile_t file, const char **line);
+
+/* Same as iobuf_getline() for records terminated by the byte delim,
+   such as '\0' for lists of file names. */
+ssize_t iobuf_getdelim(iofile_t file, const char **record, int delim);
+
+/* Same as iobuf_getdelim() for records terminated by any of the nset
+   bytes in set, such as " \t\n" for words. The record keeps the byte
+   which terminated it. */
+ssize_t iobuf_getdelims(iofile_t file, const char **record,
+                        const char *set, size_t nset);
+
 /* The iobuf_lseek() function repositions the offset of the open stream
    associated with the file argument to the argument offset according to the
-   directive whence. For details see lseek(). There are however two differences
-   from the original lseek call. First when using SEEK_CUR directive whence the
-   function may return zero instead of the absolute location offset to indicate
-   that one lseek syscall has been spared. Second the offset when using the
-   SEEK_CUR directive whence must be comprised between two constants
-   MIN_LSEEK_OFFSET and MAX_LSEEK_OFFSET. These values are large enough so the
-   user may ensure that every seek will be comprised in this interval. */
+   directive whence and returns the resulting absolute offset. For details
+   see lseek(). The offset of the stream is tracked so that a seek which
+   lands inside the data currently buffered, either with SEEK_CUR or with
+   SEEK_SET, is done without any syscall and keeps the buffer. On a pipe
+   a SEEK_CUR inside the buffer also works but returns zero since the
+   absolute offset is unknown, other seeks fail with ESPIPE. As with
+   stdio, pending writes are flushed before seeking outside the buffer and
+   a stream which is both read and written should be flushed or
+   repositioned when switching from writing to reading. */
 off_t iobuf_lseek(iofile_t file, off_t offset, int whence);
 
 #if !defined(__FreeBSD__) && defined(_LARGEFILE64_SOURCE)
-/* The iobuf_lseek64() function repositions the offset of the open stream
-   associated with the file argument to the argument offset according to the
-   directive whence. For details see lseek64(). There are however two
-   differences from the original lseek call. First when using SEEK_CUR directive
-   whence the function may return zero instead of the absolute location offset
-   to indicate that one lseek syscall has been spared. Second the offset when
-   using the SEEK_CUR directive whence must be comprised between two constants
-   MIN_LSEEK64_OFFSET and MAX_LSEEK64_OFFSET. These values are large enough so
-   the user may ensure that every seek will be comprised in this interval. */
+/* Same as iobuf_lseek() with 64 bits offsets, see lseek64(). */
 off64_t iobuf_lseek64(iofile_t file, off64_t offset, int whence);
 #endif
 
+/* Return the current absolute offset of the stream, that is the offset of
+   the next byte read or written, without any syscall. Return -1 with errno
+   set to ESPIPE if the stream is not seekable. */
+off_t iobuf_tell(iofile_t file);
+
 #endif /* _IOBUF_H_ */
@@ -29,31 +29,65 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <pthread.h>
 
-#include "iobuf.h"
+#include "iobuf_stdout.h"
 
-iofile_t iobuf_stdout;
+/* Initial size of the staging buffers. */
+#define STAGING_SIZE 4096
+
+iofile_t iobuf_stdout_shared;
+__thread iofile_t iobuf_stdout_staging;
+
+static pthread_mutex_t stdout_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void iobuf_stdout_init(void)
 {
-  iobuf_stdout = iobuf_dopen(STDOUT_FILENO);
+  iobuf_stdout_shared = iobuf_dopen(STDOUT_FILENO);
 }
 
 void iobuf_stdout_destroy(void)
 {
-  iobuf_close(iobuf_stdout);
+  iobuf_close(iobuf_stdout_shared);
 }
 
-int iobuf_printf(const char *format, ...)
+int iobuf_stdout_thread_init(void)
+{
+  iobuf_stdout_staging = iobuf_memopen(STAGING_SIZE);
+  return iobuf_stdout_staging ? 0 : -1;
+}
+
+int iobuf_stdout_commit(void)
+{
+  ssize_t n;
+
+  if(!iobuf_stdout_staging)
+    return 0;
+
+  pthread_mutex_lock(&stdout_lock);
+  n = iobuf_drain(iobuf_stdout_staging, iobuf_stdout_shared);
+  pthread_mutex_unlock(&stdout_lock);
+
+  return n < 0 ? -1 : 0;
+}
+
+void iobuf_stdout_thread_destroy(void)
 {
-  static char buf[4096];
+  if(!iobuf_stdout_staging)
+    return;
 
+  iobuf_stdout_commit();
+  iobuf_close(iobuf_stdout_staging);
+  iobuf_stdout_staging = NULL;
+}
+
+int iobuf_printf(const char *format, ...)
+{
   int wrote;
 
   va_list ap;
   va_start(ap, format);
-  wrote = vsnprintf(buf, 4096, format, ap);
-  wrote = iobuf_write(iobuf_stdout, buf, wrote);
+  wrote = iobuf_vprintf(iobuf_stdout, format, ap);
   va_end(ap);
 
   return wrote;
@@ -32,7 +32,16 @@
 
 #include "iobuf.h"
 
-iofile_t iobuf_stdout;
+/* Shared standard output stream. */
+extern iofile_t iobuf_stdout_shared;
+
+/* Per-thread staging buffer, NULL when the thread writes directly
+   to the shared stream. */
+extern __thread iofile_t iobuf_stdout_staging;
+
+/* Stream used for the standard output by the calling thread. */
+#define iobuf_stdout (iobuf_stdout_staging ? iobuf_stdout_staging : \
+                      iobuf_stdout_shared)
 
 /* Put a single character on the standard output. */
 #define iobuf_putchar(c) iobuf_putc(c, iobuf_stdout)
@@ -43,6 +52,20 @@ void iobuf_stdout_init(void);
 /* Destroy the stdout output and flush the buffers. */
 void iobuf_stdout_destroy(void);
 
+/* Give the calling thread its own staging buffer. Its output is only
+   published to the shared stream on iobuf_stdout_commit() so that the
+   records of different threads never interleave. When several threads
+   write on the standard output, each of them (including the main thread)
+   must use a staging buffer. */
+int iobuf_stdout_thread_init(void);
+
+/* Publish the content of the staging buffer of the calling thread to the
+   shared stream. This should be called at the end of each record. */
+int iobuf_stdout_commit(void);
+
+/* Commit and release the staging buffer of the calling thread. */
+void iobuf_stdout_thread_destroy(void);
+
 /* The classical printf function, fully buffered instead
    of line buffered. */
 int iobuf_printf(const char *format, ...);
@@ -575,16 +575,26 @@ static void printlong(const DISPLAY *dp)
     if (IS_NOPRINT(p))
       continue;
     sp = p->fts_statp;
-    if (f_inode)
-      (void)iobuf_printf("%*lu ", dp->s_inode, (u_long)sp->st_ino);
-    if (f_size)
-      (void)iobuf_printf("%*ld ",
-                   dp->s_block, howmany(sp->st_blocks, blocksize));
+    if (f_inode) {
+      (void)iobuf_put_udec(iobuf_stdout, sp->st_ino, dp->s_inode, ' ');
+      (void)iobuf_putchar(' ');
+    }
+    if (f_size) {
+      (void)iobuf_put_dec(iobuf_stdout, howmany(sp->st_blocks, blocksize),
+                          dp->s_block, ' ');
+      (void)iobuf_putchar(' ');
+    }
     strmode(sp->st_mode, buf);
     np = p->fts_pointer;
-    (void)iobuf_printf("%s %*u %-*s  %-*s  ", buf, dp->s_nlink,
-                 sp->st_nlink, dp->s_user, np->user, dp->s_group,
-                 np->group);
+    /* equivalent to "%s %*u %-*s  %-*s  " without printf */
+    (void)iobuf_put_str(iobuf_stdout, buf, 0);
+    (void)iobuf_putchar(' ');
+    (void)iobuf_put_udec(iobuf_stdout, sp->st_nlink, dp->s_nlink, ' ');
+    (void)iobuf_putchar(' ');
+    (void)iobuf_put_str(iobuf_stdout, np->user, -(int)dp->s_user);
+    (void)iobuf_write(iobuf_stdout, "  ", 2);
+    (void)iobuf_put_str(iobuf_stdout, np->group, -(int)dp->s_group);
+    (void)iobuf_write(iobuf_stdout, "  ", 2);
     if (S_ISCHR(sp->st_mode) || S_ISBLK(sp->st_mode))
       printdev(dp->s_size, sp->st_rdev);
     else
@@ -741,11 +751,15 @@ static int printaname(const FTSENT *p, u_long inodefield, u_long sizefield)
 
   sp = p->fts_statp;
   chcnt = 0;
-  if (f_inode)
-    chcnt += iobuf_printf("%*lu ", (int)inodefield, (u_long)sp->st_ino);
-  if (f_size)
-    chcnt += iobuf_printf("%*ld ",
-                    (int)sizefield, howmany(sp->st_blocks, blocksize));
+  if (f_inode) {
+    chcnt += iobuf_put_udec(iobuf_stdout, sp->st_ino, (int)inodefield, ' ');
+    chcnt += iobuf_write(iobuf_stdout, " ", 1);
+  }
+  if (f_size) {
+    chcnt += iobuf_put_dec(iobuf_stdout, howmany(sp->st_blocks, blocksize),
+                           (int)sizefield, ' ');
+    chcnt += iobuf_write(iobuf_stdout, " ", 1);
+  }
 #ifdef COLORLS
   if (f_color)
     color_printed = colortype(sp->st_mode);
@@ -1048,9 +1062,10 @@ static void printsize(size_t width, off_t bytes)
     char buf[HUMANVALSTR_LEN - 1 + 1];
 
     humanize_number(buf, sizeof(buf), (int64_t)bytes);
-    (void)iobuf_printf("%*s ", (u_int)width, buf);
+    (void)iobuf_put_str(iobuf_stdout, buf, (int)width);
   } else
-    (void)iobuf_printf("%*ld ", (u_int)width, bytes);
+    (void)iobuf_put_dec(iobuf_stdout, bytes, (int)width, ' ');
+  (void)iobuf_putchar(' ');
 }
 
 static void usage(void)
@@ -32,6 +32,8 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 
+#include "scan.h"
+
 static const char * queue;
 static const char * command;
 static int          av_task;
@@ -77,6 +79,7 @@ static int extract(void)
 {
   char line[4096];
   char buf[4096];
+  const char *eol;
   ssize_t n;
   int fd;
   int i;
@@ -89,18 +92,14 @@ static int extract(void)
 
   n = qread(fd, buf);
 
-  for(i = 0 ; i < n; i++) {
-    if(buf[i] == '\n') {
-      line[i] = '\0';
-      break;
-    }
-
-    line[i] = buf[i];
-  }
-
-  if(i == n)
+  eol = scan_byte(buf, n, '\n');
+  if(!eol)
     return 0;
 
+  i = eol - buf;
+  memcpy(line, buf, i);
+  line[i] = '\0';
+
   if(lseek(fd, 0, SEEK_SET) < 0)
     err(1, "cannot seek");
 
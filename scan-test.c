@@ -0,0 +1,240 @@
+/* File: scan-test.c
+
+   Copyright (c) 2018 David Hauweele <david@hauweele.net>
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the University nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+   OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+   SUCH DAMAGE. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+/* The implementations are static, the test
+   includes them to check each one of them. */
+#include "scan.c"
+
+/* Compare each implementation of the scanners with a scalar reference
+   at every alignment and for lengths below and above the vector width. */
+
+#define MAX_START  33
+#define MAX_LENGTH 100
+
+static unsigned int failures;
+
+#define CHECK(cond) do {                                     \
+    if(!(cond)) {                                            \
+      warnx("%s:%d: %s", __func__, __LINE__, #cond);         \
+      failures++;                                            \
+    }                                                        \
+  } while(0)
+
+struct impl {
+  const char *name;
+  const char *feature; /* NULL when always supported */
+  const char * (*byte)(const char *, size_t, int);
+  const char * (*set)(const char *, size_t, const char *, size_t);
+  size_t (*count)(const char *, size_t, int);
+  const char * (*nonprint)(const char *, size_t);
+};
+
+static const struct impl impls[] = {
+  { "generic", NULL, scan_byte_generic, scan_set_generic,
+    scan_count_generic, scan_nonprint_generic },
+#ifdef SCAN_X86
+  { "sse2", "sse2", scan_byte_sse2, scan_set_sse2,
+    scan_count_sse2, scan_nonprint_sse2 },
+  { "avx2", "avx2", scan_byte_avx2, scan_set_avx2,
+    scan_count_avx2, scan_nonprint_avx2 },
+#endif /* SCAN_X86 */
+  { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+static const char set[] = { ',', '\0', '\n', (char)0xff };
+
+/* Scalar references */
+static const char * ref_byte(const char *s, size_t n, int c)
+{
+  for(; n ; s++, n--)
+    if(*s == (char)c)
+      return s;
+  return NULL;
+}
+
+static const char * ref_set(const char *s, size_t n,
+                            const char *set, size_t nset)
+{
+  for(; n ; s++, n--)
+    if(ref_byte(set, nset, *s))
+      return s;
+  return NULL;
+}
+
+static size_t ref_count(const char *s, size_t n, int c)
+{
+  size_t count = 0;
+
+  for(; n ; s++, n--)
+    count += *s == (char)c;
+  return count;
+}
+
+static const char * ref_nonprint(const char *s, size_t n)
+{
+  for(; n ; s++, n--)
+    if((unsigned char)*s < 0x20 || (unsigned char)*s > 0x7e)
+      return s;
+  return NULL;
+}
+
+static int supported(const struct impl *impl)
+{
+#ifdef SCAN_X86
+  if(impl->feature && !strcmp(impl->feature, "avx2"))
+    return __builtin_cpu_supports("avx2");
+  if(impl->feature && !strcmp(impl->feature, "sse2"))
+    return __builtin_cpu_supports("sse2");
+#endif /* SCAN_X86 */
+  return 1;
+}
+
+/* Compare the implementation with the references on n bytes at s. */
+static void compare(const struct impl *impl, const char *s, size_t n)
+{
+  CHECK(impl->byte(s, n, '\n') == ref_byte(s, n, '\n'));
+  CHECK(impl->byte(s, n, '\0') == ref_byte(s, n, '\0'));
+  CHECK(impl->byte(s, n, 0xff) == ref_byte(s, n, 0xff));
+  CHECK(impl->set(s, n, set, sizeof(set)) == ref_set(s, n, set, sizeof(set)));
+  CHECK(impl->set(s, n, set, 1) == ref_set(s, n, set, 1));
+  CHECK(impl->set(s, n, set, 0) == NULL);
+  CHECK(impl->count(s, n, '\n') == ref_count(s, n, '\n'));
+  CHECK(impl->count(s, n, 0xff) == ref_count(s, n, 0xff));
+  CHECK(impl->nonprint(s, n) == ref_nonprint(s, n));
+}
+
+/* A single interesting byte at every position, or none. */
+static void test_sparse(const struct impl *impl)
+{
+  static const char targets[] = { '\n', '\0', ',', (char)0xff, 0x7f, 0x1f };
+  char buf[MAX_START + MAX_LENGTH];
+  size_t start, n, pos, t;
+
+  memset(buf, 'a', sizeof(buf));
+
+  for(start = 0 ; start < MAX_START ; start++) {
+    for(n = 0 ; n < MAX_LENGTH ; n++) {
+      compare(impl, buf + start, n);
+
+      for(pos = 0 ; pos < n ; pos++) {
+        for(t = 0 ; t < sizeof(targets) ; t++) {
+          buf[start + pos] = targets[t];
+          compare(impl, buf + start, n);
+        }
+        buf[start + pos] = 'a';
+      }
+    }
+  }
+}
+
+/* Random bytes from a small alphabet so that most vectors contain
+   several interesting bytes. */
+static void test_dense(const struct impl *impl)
+{
+  static const char alphabet[] = { 'a', ' ', '\n', '\0', ',', (char)0xff,
+                                   (char)0x80, 0x7f, '\t' };
+  char buf[MAX_START + MAX_LENGTH];
+  size_t start, n, i;
+  int round;
+
+  srand(0);
+  for(round = 0 ; round < 16 ; round++) {
+    for(i = 0 ; i < sizeof(buf) ; i++)
+      buf[i] = alphabet[rand() % sizeof(alphabet)];
+
+    for(start = 0 ; start < MAX_START ; start++)
+      for(n = 0 ; n < MAX_LENGTH ; n++)
+        compare(impl, buf + start, n);
+  }
+}
+
+/* The vectorized counters accumulate in bytes and
+   must not overflow on long runs of matches. */
+static void test_long_count(const struct impl *impl)
+{
+  size_t size = 1 << 20;
+  char *buf = malloc(size);
+  size_t i;
+
+  if(!buf)
+    err(1, "malloc");
+
+  memset(buf, '\n', size);
+  CHECK(impl->count(buf, size, '\n') == size);
+  CHECK(impl->count(buf + 3, size - 5, '\n') == size - 5);
+
+  for(i = 0 ; i < size ; i++)
+    buf[i] = rand() % 4 ? 'a' : '\n';
+  CHECK(impl->count(buf + 1, size - 1, '\n') ==
+        ref_count(buf + 1, size - 1, '\n'));
+
+  free(buf);
+}
+
+/* Sets larger than SCAN_SET_MAX go through the generic implementation. */
+static void test_large_set(void)
+{
+  static const char large[] = "abcdefghij";
+  static const char text[]  = "0123456789 ----- 0123456789 j";
+
+  CHECK(sizeof(large) - 1 > SCAN_SET_MAX);
+  CHECK(scan_set(text, sizeof(text) - 1, large, sizeof(large) - 1) ==
+        text + sizeof(text) - 2);
+}
+
+int main(void)
+{
+  const struct impl *impl;
+
+  for(impl = impls ; impl->name ; impl++) {
+    unsigned int before = failures;
+
+    if(!supported(impl))
+      continue;
+
+    test_sparse(impl);
+    test_dense(impl);
+    test_long_count(impl);
+
+    if(failures != before)
+      warnx("%s: %u failures", impl->name, failures - before);
+  }
+  test_large_set();
+
+  if(failures)
+    errx(1, "%u failures", failures);
+  printf("ok\n");
+
+  return 0;
+}
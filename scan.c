@@ -0,0 +1,328 @@
+/* Copyright (c) 2018, David Hauweele <david@hauweele.net>
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this
+       list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+   ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define SCAN_X86
+# include <immintrin.h>
+#endif
+
+#define ONES  0x0101010101010101ULL
+#define LOWS  0x7f7f7f7f7f7f7f7fULL
+
+/* Generic implementation */
+static const char * scan_byte_generic(const char *s, size_t n, int c)
+{
+  return memchr(s, c, n);
+}
+
+static const char * scan_set_generic(const char *s, size_t n,
+                                     const char *set, size_t nset)
+{
+  unsigned char delim[256] = { 0 };
+  const char *end = s + n;
+
+  while(nset--)
+    delim[(unsigned char)set[nset]] = 1;
+
+  for(; s < end ; s++)
+    if(delim[(unsigned char)*s])
+      return s;
+
+  return NULL;
+}
+
+static size_t scan_count_generic(const char *s, size_t n, int c)
+{
+  const uint64_t pattern = ONES * (unsigned char)c;
+  const char *end = s + n;
+  size_t count = 0;
+
+  /* Count null bytes in the xored words eight bytes at a time. */
+  for(; s + 8 <= end ; s += 8) {
+    uint64_t w;
+
+    memcpy(&w, s, sizeof(w));
+    w ^= pattern;
+    w  = ~(((w & LOWS) + LOWS) | w | LOWS);
+    count += __builtin_popcountll(w);
+  }
+
+  for(; s < end ; s++)
+    count += (*s == (char)c);
+
+  return count;
+}
+
+static const char * scan_nonprint_generic(const char *s, size_t n)
+{
+  const char *end = s + n;
+
+  for(; s < end ; s++)
+    if((unsigned char)*s < 0x20 || (unsigned char)*s > 0x7e)
+      return s;
+
+  return NULL;
+}
+
+#ifdef SCAN_X86
+__attribute__((target("sse2")))
+static const char * scan_byte_sse2(const char *s, size_t n, int c)
+{
+  const __m128i v = _mm_set1_epi8(c);
+  const char *end = s + n;
+
+  for(; s + 16 <= end ; s += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)s);
+    int mask  = _mm_movemask_epi8(_mm_cmpeq_epi8(x, v));
+    if(mask)
+      return s + __builtin_ctz(mask);
+  }
+
+  return scan_byte_generic(s, end - s, c);
+}
+
+__attribute__((target("sse2")))
+static const char * scan_set_sse2(const char *s, size_t n,
+                                  const char *set, size_t nset)
+{
+  __m128i v[SCAN_SET_MAX];
+  const char *end = s + n;
+  size_t i;
+
+  for(i = 0 ; i < nset ; i++)
+    v[i] = _mm_set1_epi8(set[i]);
+
+  for(; s + 16 <= end ; s += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)s);
+    __m128i m = _mm_setzero_si128();
+    int mask;
+
+    for(i = 0 ; i < nset ; i++)
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(x, v[i]));
+
+    mask = _mm_movemask_epi8(m);
+    if(mask)
+      return s + __builtin_ctz(mask);
+  }
+
+  return scan_set_generic(s, end - s, set, nset);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_count_sse2(const char *s, size_t n, int c)
+{
+  const __m128i v = _mm_set1_epi8(c);
+  const char *end = s + n;
+  size_t count = 0;
+
+  while(s + 16 <= end) {
+    __m128i acc = _mm_setzero_si128();
+    __m128i sum;
+    int i;
+
+    /* The byte counters overflow after 255 iterations. */
+    for(i = 0 ; i < 255 && s + 16 <= end ; i++, s += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *)s);
+      acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(x, v));
+    }
+
+    sum = _mm_sad_epu8(acc, _mm_setzero_si128());
+    count += _mm_cvtsi128_si32(sum) +
+             _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+  }
+
+  return count + scan_count_generic(s, end - s, c);
+}
+
+/* Printable bytes are greater than 0x1f and lower than 0x7f as signed
+   bytes, the bytes with the high bit set are negative. */
+__attribute__((target("sse2")))
+static const char * scan_nonprint_sse2(const char *s, size_t n)
+{
+  const __m128i lo = _mm_set1_epi8(0x1f);
+  const __m128i hi = _mm_set1_epi8(0x7f);
+  const char *end = s + n;
+
+  for(; s + 16 <= end ; s += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)s);
+    __m128i m = _mm_and_si128(_mm_cmpgt_epi8(x, lo), _mm_cmplt_epi8(x, hi));
+    int mask  = _mm_movemask_epi8(m) ^ 0xffff;
+    if(mask)
+      return s + __builtin_ctz(mask);
+  }
+
+  return scan_nonprint_generic(s, end - s);
+}
+
+__attribute__((target("avx2")))
+static const char * scan_byte_avx2(const char *s, size_t n, int c)
+{
+  const __m256i v = _mm256_set1_epi8(c);
+  const char *end = s + n;
+
+  for(; s + 32 <= end ; s += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)s);
+    unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, v));
+    if(mask)
+      return s + __builtin_ctz(mask);
+  }
+
+  return scan_byte_sse2(s, end - s, c);
+}
+
+__attribute__((target("avx2")))
+static const char * scan_set_avx2(const char *s, size_t n,
+                                  const char *set, size_t nset)
+{
+  __m256i v[SCAN_SET_MAX];
+  const char *end = s + n;
+  size_t i;
+
+  for(i = 0 ; i < nset ; i++)
+    v[i] = _mm256_set1_epi8(set[i]);
+
+  for(; s + 32 <= end ; s += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)s);
+    __m256i m = _mm256_setzero_si256();
+    unsigned int mask;
+
+    for(i = 0 ; i < nset ; i++)
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, v[i]));
+
+    mask = _mm256_movemask_epi8(m);
+    if(mask)
+      return s + __builtin_ctz(mask);
+  }
+
+  return scan_set_sse2(s, end - s, set, nset);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_count_avx2(const char *s, size_t n, int c)
+{
+  const __m256i v = _mm256_set1_epi8(c);
+  const char *end = s + n;
+  size_t count = 0;
+
+  while(s + 32 <= end) {
+    __m256i acc = _mm256_setzero_si256();
+    __m256i sum;
+    __m128i half;
+    int i;
+
+    for(i = 0 ; i < 255 && s + 32 <= end ; i++, s += 32) {
+      __m256i x = _mm256_loadu_si256((const __m256i *)s);
+      acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(x, v));
+    }
+
+    sum  = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+    half = _mm_add_epi64(_mm256_castsi256_si128(sum),
+                         _mm256_extracti128_si256(sum, 1));
+    count += _mm_cvtsi128_si32(half) +
+             _mm_cvtsi128_si32(_mm_srli_si128(half, 8));
+  }
+
+  return count + scan_count_sse2(s, end - s, c);
+}
+
+__attribute__((target("avx2")))
+static const char * scan_nonprint_avx2(const char *s, size_t n)
+{
+  const __m256i lo = _mm256_set1_epi8(0x1f);
+  const __m256i hi = _mm256_set1_epi8(0x7f);
+  const char *end = s + n;
+
+  for(; s + 32 <= end ; s += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)s);
+    __m256i m = _mm256_and_si256(_mm256_cmpgt_epi8(x, lo),
+                                 _mm256_cmpgt_epi8(hi, x));
+    unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(m);
+    if(mask)
+      return s + __builtin_ctz(mask);
+  }
+
+  return scan_nonprint_sse2(s, end - s);
+}
+#endif /* SCAN_X86 */
+
+static const char * (*scan_byte_impl)(const char *, size_t, int)
+  = scan_byte_generic;
+static const char * (*scan_set_impl)(const char *, size_t,
+                                     const char *, size_t)
+  = scan_set_generic;
+static size_t (*scan_count_impl)(const char *, size_t, int)
+  = scan_count_generic;
+static const char * (*scan_nonprint_impl)(const char *, size_t)
+  = scan_nonprint_generic;
+
+/* The implementations are selected before main(),
+   so that concurrent callers never race on them. */
+__attribute__((constructor))
+static void scan_init(void)
+{
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("avx2")) {
+    scan_byte_impl     = scan_byte_avx2;
+    scan_set_impl      = scan_set_avx2;
+    scan_count_impl    = scan_count_avx2;
+    scan_nonprint_impl = scan_nonprint_avx2;
+  }
+  else if(__builtin_cpu_supports("sse2")) {
+    scan_byte_impl     = scan_byte_sse2;
+    scan_set_impl      = scan_set_sse2;
+    scan_count_impl    = scan_count_sse2;
+    scan_nonprint_impl = scan_nonprint_sse2;
+  }
+#endif /* SCAN_X86 */
+}
+
+const char * scan_byte(const char *s, size_t n, int c)
+{
+  return scan_byte_impl(s, n, c);
+}
+
+const char * scan_set(const char *s, size_t n, const char *set, size_t nset)
+{
+  /* The vectorized versions keep one register per delimiter. */
+  if(nset > SCAN_SET_MAX)
+    return scan_set_generic(s, n, set, nset);
+  return scan_set_impl(s, n, set, nset);
+}
+
+size_t scan_count(const char *s, size_t n, int c)
+{
+  return scan_count_impl(s, n, c);
+}
+
+const char * scan_nonprint(const char *s, size_t n)
+{
+  return scan_nonprint_impl(s, n);
+}
@@ -0,0 +1,56 @@
+/* Copyright (c) 2018, David Hauweele <david@hauweele.net>
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this
+       list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+   ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include <stddef.h>
+
+/* Maximum number of delimiters in a set for which scan_set() is vectorized.
+   Larger sets are scanned by the generic implementation. */
+#define SCAN_SET_MAX 8
+
+/* The scanners use SSE2 or AVX2 when the CPU supports them and fallback on
+   a generic implementation otherwise. The implementation is selected at
+   runtime before main(). */
+
+/* Return a pointer to the first occurrence of the byte c
+   in the n bytes starting at s or NULL if there is none.
+   Use it with '\n' for lines and '\0' for strings. */
+const char * scan_byte(const char *s, size_t n, int c);
+
+/* Return a pointer to the first byte in the n bytes starting at s that is
+   one of the nset delimiters in set or NULL if there is none. */
+const char * scan_set(const char *s, size_t n, const char *set, size_t nset);
+
+/* Count the number of occurrences of the byte c in the
+   n bytes starting at s. For example the number of lines. */
+size_t scan_count(const char *s, size_t n, int c);
+
+/* Return a pointer to the first byte in the n bytes starting at s that is
+   not printable ASCII (0x20 to 0x7e) or NULL if there is none. That is
+   control characters, DEL and bytes with the high bit set. */
+const char * scan_nonprint(const char *s, size_t n);
+
+#endif /* _SCAN_H_ */
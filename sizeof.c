@@ -88,7 +88,12 @@ static void do_stat(const char *path)
   unsigned int len;
   ssize_t filesize;
   char buf[32];
-  char nl = '\n', sp = ' ', sc = ':';
+  struct iovec record[] = {
+    { .iov_base = (void *)path, .iov_len = strlen(path) },
+    { .iov_base = ": ",         .iov_len = 2 },
+    { .iov_base = buf,          .iov_len = 0 }, /* size field */
+    { .iov_base = "\n",         .iov_len = 1 }
+  };
 
   if(stat(path, &info) < 0) {
     warn("cannot stat \"%s\"", path);
@@ -104,12 +109,10 @@ static void do_stat(const char *path)
     len = human_size(buf, filesize);
   else
     len = sprintf(buf, "%ld", filesize);
+  record[2].iov_len = len;
 
-  iobuf_write(out, path, strlen(path));
-  iobuf_write(out, &sc, 1); /* FIXME: use iobuf_putc(out, c) instead */
-  iobuf_write(out, &sp, 1);
-  iobuf_write(out, buf, len);
-  iobuf_write(out, &nl, 1);
+  /* submit the whole record at once */
+  iobuf_writev(out, record, sizeof(record) / sizeof(struct iovec));
 }
 
 int main(int argc, char *argv[])